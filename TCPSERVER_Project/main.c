@@ -2,8 +2,55 @@
 #define STACK_USE_ICMP  1
 #define STACK_USE_ARP   1
 #define STACK_USE_TCP   1
+#define STACK_USE_UDP   1
+#define TCP_RX_ACCEPT   ModbusTCPAccept   //hold the master back, see mbtcp.h
 #include "ccstcpip.h"
-//#include "modbus_tcp.c"  // addding modbus tcp driver.
+
+#define NUM_LISTEN_SOCKETS 2
+
+#define MODBUS_UNIT 0xF7
+#define MODBUS_TCP_CONNS NUM_LISTEN_SOCKETS
+//#define MODBUS_GATEWAY      //other unit ids go out on the RTU line
+#define MODBUS_UDP            //also answer Modbus requests sent over UDP
+#define MODBUS_DIAG           //FC8 counters, FC11/FC12 event log
+#include "modbus/mbdata.c"
+#include "modbus/mbmap.c"
+#include "modbus/modbus.c"
+#ifdef MODBUS_DIAG
+ #include "modbus/mbdiag.c"
+#endif
+#ifdef MODBUS_LATENCY
+ #include "modbus/mblat.c"
+#endif
+#include "modbus/mbtcp.c"
+#ifdef MODBUS_UDP
+ #include "modbus/mbudp.c"
+#endif
+#ifdef MODBUS_RBE
+ #include "modbus/mbrbe.c"
+#endif
+#ifdef MODBUS_ADC
+ #include "modbus/mbadc.c"
+#endif
+#ifdef MODBUS_IMAGE
+ #include "modbus/mbimage.c"
+#endif
+#ifdef MODBUS_EEPROM
+ #include "modbus/mbeeprom.c"
+#endif
+#ifdef MODBUS_POLLS
+ #include "modbus/mbclient.c"
+ #ifdef MODBUS_CONCENTRATOR
+  #include "modbus/mbconc.c"
+ #endif
+#endif
+#ifdef MODBUS_GATEWAY
+ #include "modbus/mbrtu.c"
+ #ifdef MODBUS_GW_CACHE
+  #include "modbus/mbcache.c"
+ #endif
+ #include "modbus/mbgw.c"
+#endif
 
 
 #if STACK_USE_CCS_PICENS
@@ -14,68 +61,19 @@
  #include "tcpip/dlcd.c"
 #endif
 
-#define NUM_LISTEN_SOCKETS 2
-
-#define EXAMPLE_TCP_PORT   (int16)502
-
-//#define MODBUS_UNIT 0xF7
-//#define MODBUS_SERIAL_RX_BUFFER_SIZE 64
+#define EXAMPLE_TCP_PORT   MODBUS_TCP_PORT
 
 char lcd_str[NUM_LISTEN_SOCKETS][20];
 
 //this function is called by MyTCPTask() when the specified socket is connected
-//to the PC running the TCPSERVER.EXE demo.
-//returns TRUE if BUTTON2 was pressed, therefore we must disconnect the socket
+//to a Modbus TCP master.
+//returns TRUE if the socket must be disconnected, either because BUTTON2 was
+//pressed or because the master's request stream can not be framed any more
 int8 TCPConnectedTask(TCP_SOCKET socket, int8 which) {
-   char c[];
-   static int8 counter[NUM_LISTEN_SOCKETS];
-   static int8 button1_held[NUM_LISTEN_SOCKETS];   
-   char str[20];
-   int8 i=0;
-   
-   if (TCPIsGetReady(socket)) {
-      TCPGetArray(socket,c,12);
-      get_data = c;
-      array_to_frame(get_data);
-      
-      if(modbus_rx.len==12)
-      {
-         if(modbus_rx.unit==MODBUS_UNIT)
-            {
-              switch(modbus_rx.func)
-              {
-                  case FUNC_READ_HOLDING_REGISTERS:
-                  case FUNC_READ_INPUT_REGISTERS:
-                     if((modbus_rx.data[0] || modbus_rx.data[2] ||
-                  modbus_rx.data[1] >= 8 || modbus_rx.data[3]+modbus_rx.data[1] > 8)
-                  modbus_exception_rsp(MODBUS_ADDRESS,modbus_rx.func,ILLEGAL_DATA_ADDRESS);)
-            }
-         
-      }
-       else
-       {
-         arrayi_hazirla()
-         TCPPutArray(socket,,strlen());
-         TCPFlush(socket);   
-         output_low(PIN_B5);
-       }
-         lcd_str[which][i++]=c;
-         if (i>=20) {i=19;}
-         lcd_str[which][i]=0;
-      }
+   if (ModbusTCPTask(socket, which)) {
+      return(TRUE);
    }
 
-//when button 1 is pressed: send message over TCP
-//when button 2 is pressed: disconnect socket
-   if (BUTTON1_PRESSED() && !button1_held[which] && TCPIsPutReady(socket)) {
-      button1_held[which]=TRUE;
-      sprintf(str,"BUTTON C=%U",counter[which]++);
-      TCPPutArray(socket,str,strlen(str));
-      TCPFlush(socket);
-   }
-   if (!BUTTON1_PRESSED()) {
-      button1_held[which]=FALSE;
-   }
   #if defined(BUTTON2_PRESSED())
    if (BUTTON2_PRESSED()) {
       return(TRUE);
@@ -95,10 +93,11 @@ void MyTCPTask() {
    } state[NUM_LISTEN_SOCKETS]={0};
    static NODE_INFO remote[NUM_LISTEN_SOCKETS];
    TICKTYPE currTick;
-   int8 dis;
-   int8 i;
+   int8 ready, order[NUM_LISTEN_SOCKETS];
+   int8 i, k, n;
 
    currTick=TickGet();
+   ready=0;
 
    for (i=0;i<NUM_LISTEN_SOCKETS;i++) {
       switch (state[i]) {
@@ -117,24 +116,24 @@ void MyTCPTask() {
             if (TCPIsConnected(socket[i])) {
                state[i]=MYTCP_STATE_CONNECTED;
                sprintf(&lcd_str[i][0],"CONNECTED!");
+               ModbusTCPReset(i,socket[i]);
                lastTick[i]=currTick;
             }
             break;
 
          case MYTCP_STATE_CONNECTED:
             if (TCPIsConnected(socket[i])) {
+               //the idle timeout restarts with every segment from the master
+               if (TCPIsGetReady(socket[i])) {
+                  lastTick[i]=currTick;
+               }
                if (TickGetDiff(currTick,lastTick[i]) > ((int16)TICKS_PER_SECOND * 300)) {
                   state[i]=MYTCP_STATE_DISCONNECT;
                   sprintf(&lcd_str[i][0],"TIMEOUT");
                   lastTick[i]=currTick;
                }
                else {
-                  dis=TCPConnectedTask(socket[i],i);
-                  if (dis) {
-                     sprintf(&lcd_str[i][0],"DISCONNECT");
-                     state[i]=MYTCP_STATE_DISCONNECT;
-                     lastTick[i]=currTick;
-                  }
+                  bit_set(ready,i);
                }
             }
             else {
@@ -153,11 +152,24 @@ void MyTCPTask() {
             break;
 
          case MYTCP_STATE_FORCE_DISCONNECT:
+            ModbusTCPClose(i);
             TCPDisconnect(socket[i]);
             state[i]=MYTCP_STATE_NEW;
             break;
       }
    }
+
+   //the connected sockets are served in the order the scheduler picks,
+   //pending writes ahead of reads on the other socket
+   n=ModbusTCPSchedule(socket,ready,order);
+   for (k=0;k<n;k++) {
+      i=order[k];
+      if (TCPConnectedTask(socket[i],i)) {
+         sprintf(&lcd_str[i][0],"DISCONNECT");
+         state[i]=MYTCP_STATE_DISCONNECT;
+         lastTick[i]=currTick;
+      }
+   }
 }
 
 void LCDTask(void) {
@@ -197,34 +209,69 @@ void main(void)
    setup_vref(FALSE);
 //Setup_Oscillator parameter not selected from Intr Oscillator Config tab
 
-   // TODO: USER CODE!!
-   char get_data[];
-   
-
+  #ifndef MODBUS_GATEWAY     //the UART is the RTU line in gateway mode
    printf("\r\n\nCCS TCP/IP TUTORIAL, EXAMPLE 13B (TCP SERVER)\r\n");
+  #endif
    MACAddrInit();
    IPAddrInit();
 
    init_user_io();
 
    lcd_init();
+  #ifndef MODBUS_GATEWAY
    printf("deneme");
+  #endif
    delay_ms(3000);
    sprintf(&lcd_str[0][0],"INIT");
    sprintf(&lcd_str[1][0],"INIT");
    lcd_putc('\f');
 
    StackInit();
-   /*  // registers
-   int8 coils = 0b00000101;
-   int8 inputs = 0b00001001;
-   int16 hold_regs[] = {0x8800,0x7700,0x6600,0x5500,0x4400,0x3300,0x2200,0x1100};
-   int16 input_regs[] = {0x1100,0x2200,0x3300,0x4400,0x5500,0x6600,0x7700,0x8800};
-   int16 event_count = 0;
-   */
+  #ifdef MODBUS_GATEWAY
+   ModbusRTUInit();
+  #endif
+  #ifdef MODBUS_UDP
+   ModbusUDPInit();
+  #endif
+  #ifdef MODBUS_RBE
+   ModbusRBEInit();
+  #endif
+  #ifdef MODBUS_ADC
+   ModbusADCInit();
+  #endif
+  #ifdef MODBUS_EEPROM
+   ModbusEEInit();
+  #endif
+  #ifdef MODBUS_LATENCY
+   ModbusLatInit();
+  #endif
+  #ifdef MODBUS_POLLS
+   ModbusClientInit();
+  #endif
    while(TRUE) {
       StackTask();
+     #ifdef MODBUS_IMAGE
+      ModbusImageTask();
+     #endif
+     #ifdef MODBUS_UDP
+      ModbusUDPTask();
+     #endif
+     #ifdef MODBUS_RBE
+      ModbusRBETask();
+     #endif
       MyTCPTask();
+     #ifdef MODBUS_POLLS
+      ModbusClientTask();
+      #ifdef MODBUS_CONCENTRATOR
+       ModbusConcTask();
+      #endif
+     #endif
+     #ifdef MODBUS_GATEWAY
+      ModbusGatewayTask();
+     #endif
+     #ifdef MODBUS_EEPROM
+      ModbusEETask();
+     #endif
       LCDTask();
    }
 }
@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbadc.c - Interrupt driven ADC sampler, see mbadc.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbadc.h"
+
+// Timer 2 counts Fosc/64 with its 1:16 prescaler.  The period register
+// holds 8 bits, so the postscaler takes the rest, at most 1:16.
+#define MB_ADC_COUNTS      ((int32)getenv("CLOCK") / 64 / MODBUS_ADC_RATE)
+#define MB_ADC_POST        (MB_ADC_COUNTS / 256 + 1)
+#define MB_ADC_PERIOD      (MB_ADC_COUNTS / MB_ADC_POST - 1)
+
+// The same as MB_ADC_POST, without the cast the preprocessor does not take
+#if getenv("CLOCK") / 64 / MODBUS_ADC_RATE / 256 + 1 > 16
+ #error MODBUS_ADC_RATE is too low for timer 2 at this clock
+#endif
+
+// ModbusAdcChannel[]: the channels in register order
+#define MB_ADC_ENTRY(c)    c,
+
+const BYTE ModbusAdcChannel[] = {
+   MODBUS_ADC(MB_ADC_ENTRY)
+};
+
+int16 ModbusAdcAcc[MB_ADC_CHANNELS];   // running sums, see mbadc.h
+BYTE ModbusAdcNext;                    // channel being converted
+int1 ModbusAdcPrimed;                  // every sum holds a whole average
+
+//starts the conversion of the channel selected one period ago
+#int_timer2
+void ModbusADCTimerIsr(void) {
+   read_adc(ADC_START_ONLY);
+}
+
+//averages the result in, publishes the channels after the last one and
+//selects the next channel
+#int_ad
+void ModbusADCIsr(void) {
+   int16 sample;
+   BYTE i;
+
+   sample = read_adc(ADC_READ_ONLY);
+   i = ModbusAdcNext;
+   if (ModbusAdcPrimed)
+      ModbusAdcAcc[i] += sample - (ModbusAdcAcc[i] >> MODBUS_ADC_SHIFT);
+   else
+      ModbusAdcAcc[i] = sample << MODBUS_ADC_SHIFT;
+
+   if (++i == MB_ADC_CHANNELS) {
+      for (i=0;i<MB_ADC_CHANNELS;i++)
+         ModbusImagePut(MB_FEED_ADC, i, ModbusAdcAcc[i]);
+      ModbusImagePublish(MB_FEED_ADC);
+      ModbusAdcPrimed = TRUE;
+      i = 0;
+   }
+   ModbusAdcNext = i;
+   set_adc_channel(ModbusAdcChannel[i]);
+}
+
+/*********************************************************************
+ * Function:        void ModbusADCInit(void)
+ *
+ * PreCondition:    The ADC and its pins are set up (init_user_io()).
+ *
+ * Overview:        Selects the first channel and starts the sample
+ *                  clock on timer 2.
+ ********************************************************************/
+void ModbusADCInit(void) {
+   ModbusAdcNext = 0;
+   ModbusAdcPrimed = FALSE;
+   set_adc_channel(ModbusAdcChannel[0]);
+
+   setup_timer_2(T2_DIV_BY_16, MB_ADC_PERIOD, MB_ADC_POST);
+   clear_interrupt(INT_AD);
+   enable_interrupts(INT_AD);
+   enable_interrupts(INT_TIMER2);
+   enable_interrupts(GLOBAL);
+}
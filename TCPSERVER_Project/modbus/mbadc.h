@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbadc.h - Interrupt driven ADC sampler feeding the input registers.
+//
+// Reading a channel while serving a request would hold the reply for the
+// acquisition and conversion time, and the sample would be taken whenever
+// a master happens to poll.  Instead timer 2 starts a conversion
+// MODBUS_ADC_RATE times a second, and the ADC interrupt takes the result,
+// averages it and switches to the next channel of MODBUS_ADC, which then
+// has a whole period to settle.  Each channel is so sampled at a fixed
+// rate of MODBUS_ADC_RATE / (number of channels) per second.
+//
+// Every channel keeps a running average over 2^MODBUS_ADC_SHIFT samples,
+//
+//    acc = acc - acc / 2^MODBUS_ADC_SHIFT + sample
+//
+// and its register holds acc, the average scaled by 2^MODBUS_ADC_SHIFT.
+// With #device adc=8 and the default shift of 4 the register thus reads
+// 0..4080 with 12 bits of resolution.  The sum must fit 16 bits, so the
+// shift is at most 8 for an 8 bit and 6 for a 10 bit result.  The first
+// sample of each channel fills its average at once.
+//
+// The channels are listed in MODBUS_ADC, one X(channel) per register, at
+// most 16.  After each pass over the list the averages are published
+// through the feed MB_FEED_ADC (see mbimage.h), which must be listed in
+// MODBUS_IMAGE with MB_ADC_CHANNELS registers.  An FC4 read is therefore
+// a plain copy out of the input register bank.  For example:
+//
+//  #define MODBUS_ADC(X)   X(0) X(1) X(2)
+//  #define MODBUS_IMAGE(X,F) \
+//     X(F, MB_FEED_ADC, MB_INPUT, 0, MB_ADC_CHANNELS)
+//
+// Timer 2 is used for the sample clock.  The pins of the channels must be
+// analog inputs and the ADC clock set up, as init_user_io() does for AN0.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBADC_H
+#define MBADC_H
+
+#include "modbus/mbimage.h"
+
+#ifndef MODBUS_IMAGE
+ #error The ADC sampler publishes through a register feed, see mbimage.h
+#endif
+
+// Conversions per second, all channels together, at least CLOCK / 262144
+#ifndef MODBUS_ADC_RATE
+ #define MODBUS_ADC_RATE   1000
+#endif
+
+// Samples averaged: 2^MODBUS_ADC_SHIFT
+#ifndef MODBUS_ADC_SHIFT
+ #define MODBUS_ADC_SHIFT  4
+#endif
+
+#define MB_ADC_ONE(c)      + 1
+#define MB_ADC_CHANNELS    (0 MODBUS_ADC(MB_ADC_ONE))
+
+#if MB_ADC_CHANNELS > 16
+ #error At most 16 ADC channels are supported
+#endif
+
+void ModbusADCInit(void);
+
+#endif
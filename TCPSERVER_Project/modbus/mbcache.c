@@ -0,0 +1,122 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbcache.c - Register cache for the slaves behind the gateway, see
+// mbcache.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbcache.h"
+
+// ModbusCacheRange[]: the ranges, closed by an entry with function 0
+#define MB_CACHE_ENTRY(u,t,s,n,age) \
+   {u, (t) == MB_HOLDING ? FUNC_READ_HOLDING_REGISTERS : \
+                           FUNC_READ_INPUT_REGISTERS, s, n, age},
+#define MB_CACHE_ONE(u,t,s,n,age)     + 1
+#define MB_CACHE_BYTES(u,t,s,n,age)   + (n) * 2
+
+#define MB_CACHE_RANGES    (0 MODBUS_GW_CACHE(MB_CACHE_ONE))
+
+const MODBUS_CACHE_RANGE ModbusCacheRange[] = {
+   MODBUS_GW_CACHE(MB_CACHE_ENTRY)
+   {0, 0, 0, 0, 0}
+};
+
+// Values in wire order, the ranges one after the other
+BYTE ModbusCacheData[0 MODBUS_GW_CACHE(MB_CACHE_BYTES)];
+TICKTYPE ModbusCacheTime[MB_CACHE_RANGES];
+BYTE ModbusCacheValid[MB_CACHE_RANGES];
+
+//index of the range of unit and function func holding addr, or MB_NO_RANGE
+BYTE ModbusCacheFind(BYTE unit, BYTE func, int16 addr) {
+   BYTE i;
+
+   for (i=0;ModbusCacheRange[i].func;i++) {
+      if (ModbusCacheRange[i].unit == unit && ModbusCacheRange[i].func == func &&
+          addr >= ModbusCacheRange[i].start &&
+          addr < ModbusCacheRange[i].start + ModbusCacheRange[i].count)
+         return(i);
+   }
+   return(MB_NO_RANGE);
+}
+
+/*********************************************************************
+ * Function:        BOOL ModbusCacheRead(BYTE unit, int16 addr,
+ *                                       int16 qty)
+ *
+ * PreCondition:    modbus_rx holds an FC3 or FC4 request and the
+ *                  transport made sure a full ADU still fits.
+ *
+ * Output:          TRUE if the read was answered from the cache.
+ *
+ * Overview:        Answers the read if one range holds all of it and
+ *                  that range is not older than its maximum age.  A
+ *                  quantity out of 1..125 is left to the slave, which
+ *                  answers it with exception 3.
+ ********************************************************************/
+BOOL ModbusCacheRead(BYTE unit, int16 addr, int16 qty) {
+   BYTE i;
+   int16 off;
+
+   if (qty == 0 || qty > MODBUS_MAX_READ_REGS)
+      return(FALSE);
+
+   off = 0;
+   for (i=0;ModbusCacheRange[i].func;i++) {
+      if (ModbusCacheRange[i].unit == unit &&
+          ModbusCacheRange[i].func == modbus_rx.func &&
+          addr >= ModbusCacheRange[i].start &&
+          addr + qty <= ModbusCacheRange[i].start + ModbusCacheRange[i].count) {
+         if (!ModbusCacheValid[i] ||
+             TickGetDiff(TickGet(), ModbusCacheTime[i]) > ModbusCacheRange[i].max_age)
+            return(FALSE);
+         if (ModbusRspBegin(2 + qty * 2)) {
+            ModbusPut(modbus_rx.func);
+            ModbusPut(qty * 2);
+            off += (addr - ModbusCacheRange[i].start) * 2;
+            ModbusPutArray(&ModbusCacheData[off], qty * 2);
+         }
+         return(TRUE);
+      }
+      off += ModbusCacheRange[i].count * 2;
+   }
+   return(FALSE);
+}
+
+//refreshes every range that the RTU reply now in the receive ring, to a
+//read of qty registers at addr, covers completely
+void ModbusCacheFill(BYTE unit, BYTE func, int16 addr, BYTE qty) {
+   BYTE i;
+   int16 off, from, n, j;
+
+   off = 0;
+   for (i=0;ModbusCacheRange[i].func;i++) {
+      n = ModbusCacheRange[i].count * 2;
+      if (ModbusCacheRange[i].unit == unit && ModbusCacheRange[i].func == func &&
+          ModbusCacheRange[i].start >= addr &&
+          ModbusCacheRange[i].start + ModbusCacheRange[i].count <= addr + qty) {
+         //register data starts after unit id, function and byte count
+         from = 3 + (ModbusCacheRange[i].start - addr) * 2;
+         for (j=0;j<n;j++)
+            ModbusCacheData[off + j] = ModbusRTUPeek(from + j);
+         ModbusCacheTime[i] = TickGet();
+         ModbusCacheValid[i] = TRUE;
+      }
+      off += n;
+   }
+}
+
+//forgets the holding register ranges of unit that overlap qty registers at
+//addr.  qty 0 forgets all ranges of unit, for writes of unknown extent.
+void ModbusCacheInvalidate(BYTE unit, int16 addr, int16 qty) {
+   BYTE i;
+
+   for (i=0;ModbusCacheRange[i].func;i++) {
+      if (ModbusCacheRange[i].unit != unit)
+         continue;
+      if (!qty ||
+          (ModbusCacheRange[i].func == FUNC_READ_HOLDING_REGISTERS &&
+           addr < ModbusCacheRange[i].start + ModbusCacheRange[i].count &&
+           addr + qty > ModbusCacheRange[i].start))
+         ModbusCacheValid[i] = FALSE;
+   }
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbcache.h - Register cache for the slaves behind the gateway.
+//
+// Masters polling the same RTU slave at their own rates mostly ask for
+// data that was read a moment ago.  The cache keeps the last value of
+// selected register ranges of the downstream slaves in RAM, each range
+// with its own maximum age.  A read that falls inside a range read no
+// longer ago than that is answered from the cache, without a serial
+// transaction.  Every FC3/FC4 reply that covers a whole range refreshes
+// it, and the gateway widens reads into a stale range so that they do.
+// A write sent to a slave invalidates the cached ranges it may change.
+// While a write to a slave waits in the queue, its reads bypass the cache
+// and their replies do not refresh it, so no read is answered with values
+// from before a write the gateway already accepted.
+//
+// The ranges are listed in MODBUS_GW_CACHE, one X(unit, table, start,
+// count, max age in ticks) per range, table being MB_HOLDING (FC3) or
+// MB_INPUT (FC4) and count at most 125.  Without the list there is no
+// cache.  For example:
+//
+//  #define MODBUS_GW_CACHE(X) \
+//     X(0x05, MB_HOLDING,   0, 20, TICKS_PER_SECOND * 2) \
+//     X(0x05, MB_INPUT,   100, 64, TICKS_PER_SECOND / 2) \
+//     X(0x06, MB_HOLDING,  10, 10, TICKS_PER_SECOND * 10)
+//
+// The cache takes two bytes of RAM per register listed.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBCACHE_H
+#define MBCACHE_H
+
+typedef struct _MODBUS_CACHE_RANGE {
+   BYTE  unit;
+   BYTE  func;                   // FC3 or FC4
+   int16 start;
+   BYTE  count;
+   TICKTYPE max_age;
+} MODBUS_CACHE_RANGE;
+
+BYTE ModbusCacheFind(BYTE unit, BYTE func, int16 addr);
+BOOL ModbusCacheRead(BYTE unit, int16 addr, int16 qty);
+void ModbusCacheFill(BYTE unit, BYTE func, int16 addr, BYTE qty);
+void ModbusCacheInvalidate(BYTE unit, int16 addr, int16 qty);
+
+#endif
@@ -0,0 +1,388 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbclient.c - Modbus TCP client, see mbclient.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbclient.h"
+
+// ModbusPeerAddr[]: IP address of each peer
+#define MB_PEER_ADDR(id,a,b,c,d)       {a, b, c, d},
+
+const BYTE ModbusPeerAddr[MB_PEERS][4] = {
+   MODBUS_PEERS(MB_PEER_ADDR)
+};
+
+// ModbusPoll[]: the schedule
+#define MB_POLL_ENTRY(p,u,f,a,n,t,tb,i) {p, u, f, a, n, t, tb, i},
+
+const MODBUS_POLL ModbusPoll[MB_POLLS] = {
+   MODBUS_POLLS(MB_POLL_ENTRY)
+};
+
+MODBUS_PEER ModbusPeer[MB_PEERS];
+
+TICKTYPE ModbusPollDue[MB_POLLS];   // tick each poll is due
+BYTE ModbusPollOrder[MB_POLLS];     // the polls, earliest due first
+int1 ModbusPollFly[MB_POLLS];       // request sent, reply not in yet
+BYTE ModbusPollQual[MB_POLLS];      // MB_QUAL_GOOD, _EXCEPTION or _NONE
+TICKTYPE ModbusPollTime[MB_POLLS];  // tick of the last good reply
+
+static BYTE ModbusClientNext;       // peer whose due polls go out next
+static BYTE ModbusClientSeq;        // high byte of the transaction ids
+
+#define MB_NO_POLL         0xFF
+
+//moves the poll at position i of ModbusPollOrder[] to its place for
+//being due at tick due
+static void ModbusClientReschedule(BYTE i, TICKTYPE due) {
+   BYTE poll;
+
+   poll = ModbusPollOrder[i];
+   for (;i+1<MB_POLLS;i++) {
+      if ((signed int16)(due - ModbusPollDue[ModbusPollOrder[i+1]]) < 0)
+         break;
+      ModbusPollOrder[i] = ModbusPollOrder[i+1];
+   }
+   ModbusPollOrder[i] = poll;
+   ModbusPollDue[poll] = due;
+}
+
+//moves the polls of peer, which is not up, that fell a period behind to
+//one period from now.  left alone, they would fall so far behind the 16
+//bit tick count that they look due in the future and stall the polls of
+//the other peers.
+static void ModbusClientHold(BYTE peer) {
+   BYTE i, n, poll;
+   TICKTYPE now;
+
+   now = TickGet();
+   i = 0;
+   for (n=0;n<MB_POLLS;n++) {
+      poll = ModbusPollOrder[i];
+      if ((signed int16)(now - ModbusPollDue[poll]) < 0)
+         break;                     //the rest is not due yet
+      if (ModbusPoll[poll].peer == peer &&
+          (signed int16)(now - ModbusPollDue[poll]) >= ModbusPoll[poll].period)
+         ModbusClientReschedule(i, now + ModbusPoll[poll].period);
+      else
+         i++;
+   }
+}
+
+//drops the connection to peer.  its unanswered polls may be sent again
+//once it is back up.
+static void ModbusClientDrop(BYTE peer) {
+   MODBUS_PEER *p;
+   BYTE i;
+
+   p = &ModbusPeer[peer];
+   if (p->state >= MB_PEER_CONNECT)
+      TCPDisconnect(p->socket);
+   for (i=0;i<p->fly;i++)
+      ModbusPollFly[p->poll[i]] = FALSE;
+   p->fly = 0;
+   p->state = MB_PEER_IDLE;
+   p->time = TickGet();
+   ModbusClientHold(peer);
+}
+
+//IP address of peer
+static void ModbusClientAddr(BYTE peer, IP_ADDR *ip) {
+   BYTE k;
+
+   for (k=0;k<4;k++)
+      ip->v[k] = ModbusPeerAddr[peer][k];
+}
+
+//address to ask ARP for to reach peer: its own, or the gateway's
+static void ModbusClientNextHop(BYTE peer, IP_ADDR *hop) {
+   ModbusClientAddr(peer, hop);
+   if ((hop->Val ^ AppConfig.MyIPAddr.Val) & AppConfig.MyMask.Val)
+      hop->Val = AppConfig.MyGateway.Val;
+}
+
+//steps the connection to peer on, TRUE once it is up
+static BOOL ModbusClientConnect(BYTE peer) {
+   MODBUS_PEER *p;
+   IP_ADDR hop;
+
+   p = &ModbusPeer[peer];
+   switch (p->state) {
+      case MB_PEER_IDLE:
+         if (TickGetDiff(TickGet(), p->time) < MODBUS_CLIENT_RETRY ||
+             !ARPIsTxReady())
+            break;
+         ModbusClientNextHop(peer, &hop);
+         ARPResolve(&hop);
+         p->state = MB_PEER_ARP;
+         p->time = TickGet();
+         break;
+
+      case MB_PEER_ARP:
+         ModbusClientNextHop(peer, &hop);
+         if (ARPIsResolved(&hop, &p->node.MACAddr)) {
+            ModbusClientAddr(peer, &p->node.IPAddr);
+            p->socket = TCPConnect(&p->node, MODBUS_TCP_PORT);
+            if (p->socket == INVALID_SOCKET) {
+               p->state = MB_PEER_IDLE;
+               break;
+            }
+            p->state = MB_PEER_CONNECT;
+            p->time = TickGet();
+         }
+         else if (TickGetDiff(TickGet(), p->time) > MODBUS_CLIENT_TIMEOUT) {
+            p->state = MB_PEER_IDLE;
+         }
+         break;
+
+      case MB_PEER_CONNECT:
+         if (TCPIsConnected(p->socket)) {
+            p->state = MB_PEER_UP;
+            p->got = 0;
+            p->fly = 0;
+         }
+         else if (TickGetDiff(TickGet(), p->time) > MODBUS_CLIENT_TIMEOUT) {
+            ModbusClientDrop(peer);
+         }
+         break;
+
+      case MB_PEER_UP:
+         if (TCPIsConnected(p->socket))
+            return(TRUE);
+         ModbusClientDrop(peer);
+         break;
+   }
+   return(FALSE);
+}
+
+//data bytes a reply to poll carries
+static int16 ModbusClientDataLen(BYTE poll) {
+   if (ModbusPoll[poll].func <= FUNC_READ_DISCRETE_INPUT)
+      return((ModbusPoll[poll].count + 7) / 8);
+   return(ModbusPoll[poll].count * 2);
+}
+
+//removes the oldest request of peer, its reply with outcome qual is in
+static void ModbusClientRetire(MODBUS_PEER *p, BYTE qual) {
+   BYTE i;
+
+   ModbusPollFly[p->poll[0]] = FALSE;
+   ModbusPollQual[p->poll[0]] = qual;
+   if (qual == MB_QUAL_GOOD)
+      ModbusPollTime[p->poll[0]] = TickGet();
+   p->fly--;
+   for (i=0;i<p->fly;i++)
+      p->poll[i] = p->poll[i+1];
+   p->time = TickGet();
+}
+
+//checks the header of a reply just received.  replies come in the order
+//the requests went out, so it must answer the oldest one.
+static BOOL ModbusClientHeader(MODBUS_PEER *p) {
+   BYTE poll;
+   int16 len;
+
+   if (!p->fly)
+      return(FALSE);
+   poll = p->poll[0];
+   len = make16(p->hdr[4], p->hdr[5]);
+   if (p->hdr[1] != poll || p->hdr[2] || p->hdr[3] ||
+       p->hdr[6] != ModbusPoll[poll].unit)
+      return(FALSE);
+
+   //exception: the header was the whole reply
+   if (p->hdr[7] == (ModbusPoll[poll].func | 0x80)) {
+      if (len != 3)
+         return(FALSE);
+      ModbusClientRetire(p, MB_QUAL_EXCEPTION);
+      p->got = 0;
+      return(TRUE);
+   }
+
+   if (p->hdr[7] != ModbusPoll[poll].func ||
+       p->hdr[8] != ModbusClientDataLen(poll) || len != 3 + p->hdr[8])
+      return(FALSE);
+   p->cur = poll;
+   p->pos = 0;
+   p->left = p->hdr[8];
+   return(TRUE);
+}
+
+//stores data byte b of the reply being received
+static void ModbusClientData(MODBUS_PEER *p, BYTE b) {
+   BYTE table;
+   BYTE *bank;
+   int16 i, n;
+
+   table = ModbusPoll[p->cur].table;
+   if (table == MB_COILS || table == MB_DISCRETE) {
+      bank = (table == MB_COILS) ? coils : inputs;
+      n = ModbusPoll[p->cur].count - p->pos * 8;
+      ModbusBitsPut(bank, ModbusPoll[p->cur].index + p->pos * 8, b, n > 8 ? 8 : n);
+   }
+   else if (!(p->pos & 1)) {
+      p->hi = b;
+   }
+   else {
+      //both bytes of a register are stored in the same call
+      bank = (table == MB_HOLDING) ? hold_regs : input_regs;
+      i = ModbusPoll[p->cur].index * 2 + p->pos - 1;
+      bank[i] = p->hi;
+      bank[i + 1] = b;
+   }
+   p->pos++;
+}
+
+//marks the registers of poll written
+static void ModbusClientDirty(BYTE poll) {
+   if (ModbusPoll[poll].table == MB_HOLDING)
+      ModbusRegsDirty(hold_dirty, ModbusPoll[poll].index, ModbusPoll[poll].count);
+   else if (ModbusPoll[poll].table == MB_INPUT)
+      ModbusRegsDirty(input_dirty, ModbusPoll[poll].index, ModbusPoll[poll].count);
+}
+
+//feeds the segment received from peer through its reply parser.  returns
+//FALSE if the replies do not match the requests.
+static BOOL ModbusClientReceive(BYTE peer) {
+   MODBUS_PEER *p;
+   BYTE b;
+
+   p = &ModbusPeer[peer];
+   while (TCPGet(p->socket, &b)) {
+      if (p->got < MB_CLIENT_HDR) {
+         p->hdr[p->got++] = b;
+         if (p->got == MB_CLIENT_HDR && !ModbusClientHeader(p))
+            return(FALSE);
+         continue;
+      }
+      ModbusClientData(p, b);
+      if (!--p->left) {
+         ModbusClientDirty(p->cur);
+         ModbusClientRetire(p, MB_QUAL_GOOD);
+         p->got = 0;
+      }
+   }
+   return(TRUE);
+}
+
+//sends the due polls of peer in one segment, as many as the pipeline and
+//the segment take
+static void ModbusClientSend(BYTE peer) {
+   MODBUS_PEER *p;
+   BYTE i, poll, n;
+   BYTE req[MODBUS_MBAP_LEN + 5];
+   TICKTYPE now, due;
+
+   p = &ModbusPeer[peer];
+   now = TickGet();
+   n = 0;
+   i = 0;
+   while (i < MB_POLLS && p->fly < MODBUS_CLIENT_PIPELINE) {
+      poll = ModbusPollOrder[i];
+      if ((signed int16)(now - ModbusPollDue[poll]) < 0)
+         break;                     //the rest is not due yet
+      if (ModbusPoll[poll].peer != peer || ModbusPollFly[poll]) {
+         i++;
+         continue;
+      }
+      if (!TCPPutReserve(p->socket, sizeof(req)))
+         break;
+
+      req[0] = ModbusClientSeq;
+      req[1] = poll;
+      req[2] = 0;
+      req[3] = 0;
+      req[4] = 0;
+      req[5] = 6;
+      req[6] = ModbusPoll[poll].unit;
+      req[7] = ModbusPoll[poll].func;
+      req[8] = make8(ModbusPoll[poll].addr,1);
+      req[9] = make8(ModbusPoll[poll].addr,0);
+      req[10] = make8(ModbusPoll[poll].count,1);
+      req[11] = make8(ModbusPoll[poll].count,0);
+      MACPutArray(req, sizeof(req));
+      n++;
+
+      if (!p->fly)
+         p->time = now;
+      p->poll[p->fly++] = poll;
+      ModbusPollFly[poll] = TRUE;
+
+      //due one period on, or one period from now if that is past
+      due = ModbusPollDue[poll] + ModbusPoll[poll].period;
+      if ((signed int16)(now - due) >= 0)
+         due = now + ModbusPoll[poll].period;
+      ModbusClientReschedule(i, due);
+   }
+   if (n) {
+      TCPFlush(p->socket);
+      ModbusClientSeq++;
+   }
+}
+
+/*********************************************************************
+ * Function:        void ModbusClientInit(void)
+ *
+ * PreCondition:    StackInit() was called.
+ *
+ * Overview:        Makes every poll due at once and every peer ready
+ *                  to connect.
+ ********************************************************************/
+void ModbusClientInit(void) {
+   BYTE i;
+
+   for (i=0;i<MB_POLLS;i++) {
+      ModbusPollOrder[i] = i;
+      ModbusPollDue[i] = TickGet();
+      ModbusPollFly[i] = FALSE;
+      ModbusPollQual[i] = MB_QUAL_NONE;
+      ModbusPollTime[i] = TickGet();
+   }
+   for (i=0;i<MB_PEERS;i++) {
+      ModbusPeer[i].state = MB_PEER_IDLE;
+      ModbusPeer[i].time = TickGet() - MODBUS_CLIENT_RETRY;
+      ModbusPeer[i].fly = 0;
+   }
+}
+
+/*********************************************************************
+ * Function:        void ModbusClientTask(void)
+ *
+ * PreCondition:    ModbusClientInit() was called.
+ *
+ * Overview:        Keeps the peers connected, parses the replies they
+ *                  sent, and sends the due polls of one peer.
+ *
+ * Note:            Call from the main loop once per StackTask(), which
+ *                  drops a received segment on its next call.  The one
+ *                  MAC transmit buffer takes the segment of one socket
+ *                  at a time, so the peers take turns sending.
+ ********************************************************************/
+void ModbusClientTask(void) {
+   MODBUS_PEER *p;
+   BYTE i;
+
+   for (i=0;i<MB_PEERS;i++) {
+      p = &ModbusPeer[i];
+      if (!ModbusClientConnect(i)) {
+         if (p->state != MB_PEER_UP)
+            ModbusClientHold(i);
+         continue;
+      }
+      if (TCPIsGetReady(p->socket)) {
+         if (!ModbusClientReceive(i)) {
+            ModbusClientDrop(i);
+            continue;
+         }
+         TCPDiscard(p->socket);
+      }
+      if (p->fly && TickGetDiff(TickGet(), p->time) > MODBUS_CLIENT_TIMEOUT)
+         ModbusClientDrop(i);
+   }
+
+   if (ModbusPeer[ModbusClientNext].state == MB_PEER_UP)
+      ModbusClientSend(ModbusClientNext);
+   if (++ModbusClientNext == MB_PEERS)
+      ModbusClientNext = 0;
+}
@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbclient.h - Modbus TCP client: polls peer devices into the local map.
+//
+// The board reads registers and bits of other Modbus TCP devices on a
+// fixed schedule and stores them in its own banks, where the local
+// masters read them like any other data.  Each peer is kept connected,
+// and requests to it are pipelined: every request due for a peer goes out
+// in one segment, and up to MODBUS_CLIENT_PIPELINE of them may wait for
+// their replies at a time.
+//
+// The peers are listed in MODBUS_PEERS, one X(id, a, b, c, d) per device
+// at IP address a.b.c.d, port MODBUS_TCP_PORT.  The polls are listed in
+// MODBUS_POLLS, one X(peer, unit, function, address, count, period,
+// table, index) per poll: every period ticks, read count registers or
+// bits from address of unit at the peer named id with function 1 to 4,
+// and store them in table (MB_COILS or MB_DISCRETE for functions 1 and 2,
+// MB_HOLDING or MB_INPUT for 3 and 4) from storage index index on.  For
+// example:
+//
+//  #define MODBUS_PEERS(X) \
+//     X(MB_PEER_PLC,   192,168,1,20) \
+//     X(MB_PEER_METER, 192,168,1,21)
+//  #define MODBUS_POLLS(X) \
+//     X(MB_PEER_PLC,   1, 3,   0, 20,  5, MB_INPUT,   0) \
+//     X(MB_PEER_PLC,   1, 1, 100, 64, 10, MB_DISCRETE, 0) \
+//     X(MB_PEER_METER, 1, 4,   0,  8, 10, MB_INPUT,  20)
+//
+// The polls wait in ModbusPollOrder[] sorted by the tick they are due, so
+// the scheduler only looks at the polls at its front.  A poll is due
+// again one period after it was due, or one period after it was sent if
+// it fell behind by more than that.  A poll is not sent again while its
+// last request is unanswered.  The polls of a peer that is not connected
+// stay no more than a period behind, the same way.
+//
+// Replies are parsed as they arrive and their data is stored straight into
+// the bank, a register at a time, without a reassembly buffer.  A peer
+// that does not answer within MODBUS_CLIENT_TIMEOUT ticks, or answers out
+// of order, is disconnected and connected again after MODBUS_CLIENT_RETRY
+// ticks.  An exception reply leaves the old values in place.
+// ModbusPollQual[] records the outcome of the last reply to each poll, and
+// ModbusPollTime[] the tick of the last good one.
+//
+// Each peer takes one TCP socket, besides the ones listening, out of
+// MAX_SOCKETS.  A peer outside the local subnet is reached through the
+// gateway of AppConfig.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBCLIENT_H
+#define MBCLIENT_H
+
+#include "modbus/modbus.h"
+
+// Requests waiting for their replies per peer
+#ifndef MODBUS_CLIENT_PIPELINE
+ #define MODBUS_CLIENT_PIPELINE   4
+#endif
+
+// Ticks to wait for a reply, and for ARP and the connection
+#ifndef MODBUS_CLIENT_TIMEOUT
+ #define MODBUS_CLIENT_TIMEOUT    TICKS_PER_SECOND
+#endif
+
+// Ticks between connection attempts
+#ifndef MODBUS_CLIENT_RETRY
+ #define MODBUS_CLIENT_RETRY      (TICKS_PER_SECOND * 5)
+#endif
+
+// Peer ids, in list order from 0
+#define MB_PEER_ID(id,a,b,c,d)         id,
+enum { MODBUS_PEERS(MB_PEER_ID) MB_PEER_END };
+
+#define MB_PEER_ONE(id,a,b,c,d)        + 1
+#define MB_PEERS                       (0 MODBUS_PEERS(MB_PEER_ONE))
+#define MB_POLL_ONE(p,u,f,a,n,t,tb,i)  + 1
+#define MB_POLLS                       (0 MODBUS_POLLS(MB_POLL_ONE))
+
+#if MB_POLLS > 64
+ #error At most 64 polls are supported
+#endif
+
+// MBAP header, function code and byte count or exception code
+#define MB_CLIENT_HDR      (MODBUS_MBAP_LEN + 2)
+
+typedef struct _MODBUS_POLL {
+   BYTE  peer;
+   BYTE  unit;
+   BYTE  func;
+   int16 addr;
+   int16 count;
+   int16 period;                 // ticks
+   BYTE  table;
+   int16 index;
+} MODBUS_POLL;
+
+// Outcome of the last reply to a poll
+#define MB_QUAL_GOOD       0     // data stored
+#define MB_QUAL_STALE      1     // see mbconc.h
+#define MB_QUAL_EXCEPTION  2     // exception reply, the data is older
+#define MB_QUAL_OFFLINE    3     // see mbconc.h
+#define MB_QUAL_NONE       4     // no reply yet
+
+// Connection states of a peer
+#define MB_PEER_IDLE       0     // waiting to connect
+#define MB_PEER_ARP        1     // MAC address asked for
+#define MB_PEER_CONNECT    2     // SYN sent
+#define MB_PEER_UP         3
+
+typedef struct _MODBUS_PEER {
+   NODE_INFO  node;
+   TCP_SOCKET socket;
+   BYTE       state;
+   TICKTYPE   time;              // state entered, or last reply or first request
+   BYTE       fly;               // requests waiting for their replies
+   BYTE       poll[MODBUS_CLIENT_PIPELINE];    // their polls, oldest first
+   // reply parser
+   BYTE       hdr[MB_CLIENT_HDR];
+   BYTE       got;               // header bytes received
+   BYTE       cur;               // poll whose data is coming
+   int16      pos;               // data bytes received
+   int16      left;              // data bytes to come
+   BYTE       hi;                // first byte of a register split in two
+} MODBUS_PEER;
+
+void ModbusClientInit(void);
+void ModbusClientTask(void);
+
+#endif
@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbconc.c - Concentrator block status, see mbconc.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbconc.h"
+
+static TICKTYPE ModbusConcTick;     // tick of the last refresh
+
+//quality of the data of poll now, see mbconc.h
+static BYTE ModbusConcQuality(BYTE poll, int16 age) {
+   if (ModbusPollQual[poll] == MB_QUAL_NONE)
+      return(MB_QUAL_NONE);
+   if (ModbusPeer[ModbusPoll[poll].peer].state != MB_PEER_UP)
+      return(MB_QUAL_OFFLINE);
+   if (ModbusPollQual[poll] == MB_QUAL_EXCEPTION)
+      return(MB_QUAL_EXCEPTION);
+   if (age > (int32)ModbusPoll[poll].period * MODBUS_CONC_STALE)
+      return(MB_QUAL_STALE);
+   return(MB_QUAL_GOOD);
+}
+
+/*********************************************************************
+ * Function:        void ModbusConcTask(void)
+ *
+ * PreCondition:    ModbusClientInit() was called.
+ *
+ * Overview:        Once per tick, writes the quality and the age of
+ *                  every polled block into the status registers.
+ *
+ * Note:            Call from the main loop after ModbusClientTask().
+ ********************************************************************/
+void ModbusConcTask(void) {
+   BYTE poll;
+   int16 idx, age;
+   TICKTYPE now;
+
+   now = TickGet();
+   if (now == ModbusConcTick)
+      return;
+   ModbusConcTick = now;
+
+   idx = MODBUS_CONCENTRATOR;
+   for (poll=0;poll<MB_POLLS;poll++,idx+=2) {
+      age = TickGetDiff(now, ModbusPollTime[poll]);
+      //pin the reply time before the tick counter wraps past it
+      if (bit_test(age, 15)) {
+         ModbusPollTime[poll] = now - 0x8000;
+         age = 0xFFFF;
+      }
+      if (ModbusPollQual[poll] == MB_QUAL_NONE)
+         age = 0xFFFF;
+      ModbusInputSet(idx, ModbusConcQuality(poll, age));
+      ModbusInputSet(idx + 1, age);
+   }
+}
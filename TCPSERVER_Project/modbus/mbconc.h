@@ -0,0 +1,49 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbconc.h - Concentrator: quality and age of every polled block.
+//
+// With the client of mbclient.h polling the field devices into the local
+// banks, one upstream read collects the data of all of them, and never
+// waits for the field: requests are served from the banks only, whatever
+// state the peers are in.  The upstream master still has to know how good
+// each block is, so the concentrator keeps two input registers per poll
+// of MODBUS_POLLS, in list order:
+//
+//    MODBUS_CONCENTRATOR + 2 * n      quality of block n
+//    MODBUS_CONCENTRATOR + 2 * n + 1  its age, ticks since its last
+//                                     good reply, 0xFFFF from 0x8000 ticks on
+//                                     and before the first one
+//
+// The quality is the first that applies of:
+//
+//    MB_QUAL_NONE       no reply yet, the registers hold their defaults
+//    MB_QUAL_OFFLINE    the peer is not connected
+//    MB_QUAL_EXCEPTION  the peer answered the last poll with an exception
+//    MB_QUAL_STALE      no good reply for MODBUS_CONC_STALE periods
+//    MB_QUAL_GOOD
+//
+// so an upstream read of the status block along with the data tells the
+// value of every block and how far to trust it.  Define
+// MODBUS_CONCENTRATOR as the storage index of the status block in the
+// input register bank to enable it.  The registers are refreshed once per
+// tick.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBCONC_H
+#define MBCONC_H
+
+#include "modbus/mbclient.h"
+
+// Periods without a good reply before a block is stale
+#ifndef MODBUS_CONC_STALE
+ #define MODBUS_CONC_STALE  3
+#endif
+
+#if MODBUS_CONCENTRATOR + 2 * MB_POLLS > MODBUS_INPUT_REGS
+ #error The block status registers do not fit the input register bank
+#endif
+
+void ModbusConcTask(void);
+
+#endif
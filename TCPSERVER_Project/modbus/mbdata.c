@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbdata.c - Modbus register store, see mbdata.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbdata.h"
+
+int16 ModbusHoldingGet(int16 addr) {
+   addr <<= 1;
+   return(make16(hold_regs[addr], hold_regs[addr+1]));
+}
+
+void ModbusHoldingSet(int16 addr, int16 val) {
+   ModbusRegDirty(hold_dirty, addr);
+   addr <<= 1;
+   hold_regs[addr] = make8(val,1);
+   hold_regs[addr+1] = make8(val,0);
+}
+
+int16 ModbusInputGet(int16 addr) {
+   addr <<= 1;
+   return(make16(input_regs[addr], input_regs[addr+1]));
+}
+
+void ModbusInputSet(int16 addr, int16 val) {
+   ModbusRegDirty(input_dirty, addr);
+   addr <<= 1;
+   input_regs[addr] = make8(val,1);
+   input_regs[addr+1] = make8(val,0);
+}
+
+#ifdef MODBUS_RBE
+//marks the blocks of qty registers starting at storage index index dirty
+void ModbusRegsDirty(BYTE *dirty, int16 index, int16 qty) {
+   int16 b, last;
+
+   b = index >> MB_DIRTY_SHIFT;
+   last = (index + qty - 1) >> MB_DIRTY_SHIFT;
+   for (;b<=last;b++)
+      bit_set(dirty[b >> 3], b & 7);
+}
+#endif
+
+int1 ModbusCoilGet(int16 addr) {
+   return(bit_test(coils[addr >> 3], addr & 7));
+}
+
+void ModbusCoilSet(int16 addr, int1 val) {
+   if (val)
+      bit_set(coils[addr >> 3], addr & 7);
+   else
+      bit_clear(coils[addr >> 3], addr & 7);
+}
+
+int1 ModbusDiscreteGet(int16 addr) {
+   return(bit_test(inputs[addr >> 3], addr & 7));
+}
+
+void ModbusDiscreteSet(int16 addr, int1 val) {
+   if (val)
+      bit_set(inputs[addr >> 3], addr & 7);
+   else
+      bit_clear(inputs[addr >> 3], addr & 7);
+}
+
+//returns the 8 points starting at point addr of bank, first point in bit 0
+BYTE ModbusBitsGet(BYTE *bank, int16 addr) {
+   BYTE sh;
+
+   bank += addr >> 3;
+   sh = addr & 7;
+   if (!sh)
+      return(bank[0]);
+   return((bank[0] >> sh) | (bank[1] << (8 - sh)));
+}
+
+//stores the low nbits bits of val (1..8) at points addr.. of bank
+void ModbusBitsPut(BYTE *bank, int16 addr, BYTE val, int8 nbits) {
+   BYTE sh, mask;
+
+   bank += addr >> 3;
+   sh = addr & 7;
+   mask = 0xFF >> (8 - nbits);
+   val &= mask;
+
+   bank[0] = (bank[0] & ~(mask << sh)) | (val << sh);
+   if (sh + nbits > 8) {
+      sh = 8 - sh;
+      bank[1] = (bank[1] & ~(mask >> sh)) | (val >> sh);
+   }
+}
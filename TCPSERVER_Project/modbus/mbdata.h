@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbdata.h - Modbus register store.
+//
+// The holding and input register banks are statically allocated and sized
+// at compile time.  Each bank is one contiguous array kept in Modbus wire
+// order (big endian, high byte first), so a whole FC3/FC4 request is served
+// with one range check and one burst copy into the NIC, and the
+// application reads and writes single registers with the access functions
+// below.  Those are for main loop code.  Interrupt handlers publish their
+// values through the double buffered feeds of mbimage.h instead, so that
+// a block copy never sees a register half written.
+//
+// With MODBUS_RBE defined (see mbrbe.h), each register bank also keeps a
+// dirty bitmap, one bit per block of 16 registers.  Every write to a
+// register sets the bit of its block, so a scan for changed values only
+// looks at the blocks written since the last scan.  Values of interrupt
+// handlers are marked when ModbusImageTask() copies their feeds in.
+//
+// Coils and discrete inputs are packed 8 to a byte, point n in bit n&7 of
+// byte n>>3, the same order Modbus uses on the wire.  Requests move them a
+// byte at a time with ModbusBitsGet()/ModbusBitsPut(), which shift whole
+// bytes into place instead of looping over single bits.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBDATA_H
+#define MBDATA_H
+
+#ifndef MODBUS_HOLD_REGS
+ #define MODBUS_HOLD_REGS  128
+#endif
+#ifndef MODBUS_INPUT_REGS
+ #define MODBUS_INPUT_REGS 128
+#endif
+
+#ifndef MODBUS_COILS
+ #define MODBUS_COILS      512
+#endif
+#ifndef MODBUS_INPUTS
+ #define MODBUS_INPUTS     512
+#endif
+
+// Largest quantity a single request may ask for
+#define MODBUS_MAX_READ_REGS  125
+#define MODBUS_MAX_WRITE_REGS 123
+#define MODBUS_MAX_RW_WRITE_REGS 121
+#define MODBUS_MAX_READ_BITS  2000
+#define MODBUS_MAX_WRITE_BITS 1968
+
+BYTE hold_regs[MODBUS_HOLD_REGS * 2];
+BYTE input_regs[MODBUS_INPUT_REGS * 2];
+
+#ifdef MODBUS_RBE
+ // Dirty bitmaps, bit b&7 of byte b>>3 for the block of registers b*16..
+ #define MB_DIRTY_SHIFT    4
+ BYTE hold_dirty[(MODBUS_HOLD_REGS + 127) / 128];
+ BYTE input_dirty[(MODBUS_INPUT_REGS + 127) / 128];
+
+ #define ModbusRegDirty(dirty, index) \
+   bit_set(dirty[(index) >> (MB_DIRTY_SHIFT + 3)], ((index) >> MB_DIRTY_SHIFT) & 7)
+ void ModbusRegsDirty(BYTE *dirty, int16 index, int16 qty);
+#else
+ #define ModbusRegDirty(dirty, index)
+ #define ModbusRegsDirty(dirty, index, qty)
+#endif
+
+// One spare byte each, so ModbusBitsGet() may always look one byte ahead
+BYTE coils[(MODBUS_COILS + 7) / 8 + 1];
+BYTE inputs[(MODBUS_INPUTS + 7) / 8 + 1];
+
+int16 ModbusHoldingGet(int16 addr);
+void  ModbusHoldingSet(int16 addr, int16 val);
+int16 ModbusInputGet(int16 addr);
+void  ModbusInputSet(int16 addr, int16 val);
+
+int1  ModbusCoilGet(int16 addr);
+void  ModbusCoilSet(int16 addr, int1 val);
+int1  ModbusDiscreteGet(int16 addr);
+void  ModbusDiscreteSet(int16 addr, int1 val);
+
+BYTE  ModbusBitsGet(BYTE *bank, int16 addr);
+void  ModbusBitsPut(BYTE *bank, int16 addr, BYTE val, int8 nbits);
+
+#endif
@@ -0,0 +1,151 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbdiag.c - Modbus diagnostics, see mbdiag.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbdiag.h"
+
+//clears the counters and the diagnostic register, they lead the struct.
+//the FC8 request that clears them is counted as an event once answered,
+//so the event counter starts one below 0 and comes out 0.
+static void ModbusDiagClear(void) {
+   memset(&ModbusDiag, 0, (BYTE *)&ModbusDiag.head - (BYTE *)&ModbusDiag);
+   ModbusDiag.events--;
+}
+
+//FC8: the query data is echoed, or replaced by the counter asked for
+static void ModbusDiagnostics(void) {
+   BYTE req[4];
+   int16 sub, val;
+
+   if (modbus_rx.remain < 2) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 2);
+   sub = make16(req[0], req[1]);
+
+   //return query data: any length, copied from the request to the reply
+   if (sub == 0x00) {
+      if (ModbusRspBegin(3 + modbus_rx.remain)) {
+         ModbusPut(modbus_rx.func);
+         ModbusPutArray(req, 2);
+         while (modbus_rx.remain)
+            ModbusPut(ModbusGet());
+      }
+      return;
+   }
+
+   if (modbus_rx.remain != 2) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(&req[2], 2);
+   val = make16(req[2], req[3]);
+
+   switch (sub) {
+      case 0x01:
+         if (val != 0x0000 && val != 0xFF00) {
+            ModbusException(ILLEGAL_DATA_VALUE);
+            return;
+         }
+         ModbusDiagClear();
+         if (val) {
+            ModbusDiag.head = 0;
+            ModbusDiag.full = FALSE;
+         }
+         ModbusDiagEvent(MB_EV_RESTART);
+         break;
+
+      case 0x02:
+         val = ModbusDiag.reg;
+         break;
+
+      case 0x0A:
+         ModbusDiagClear();
+         break;
+
+      case 0x0B: case 0x0C: case 0x0D: case 0x0E:
+      case 0x0F: case 0x10: case 0x11: case 0x12:
+         val = (&ModbusDiag.bus_msg)[sub - 0x0B];
+         break;
+
+      case 0x14:
+         ModbusDiag.overrun = 0;
+         break;
+
+      default:
+         ModbusException(ILLEGAL_FUNCTION);
+         return;
+   }
+
+   if (ModbusRspBegin(5)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPutArray(req, 2);
+      ModbusPut(make8(val,1));
+      ModbusPut(make8(val,0));
+   }
+}
+
+//FC11: status word, never busy, and the event counter
+static void ModbusCommEventCounter(void) {
+   if (modbus_rx.remain) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   if (ModbusRspBegin(5)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPut(0);
+      ModbusPut(0);
+      ModbusPut(make8(ModbusDiag.events,1));
+      ModbusPut(make8(ModbusDiag.events,0));
+   }
+}
+
+//FC12: status, event and message counters, then the log newest first
+static void ModbusCommEventLog(void) {
+   BYTE n, i;
+
+   if (modbus_rx.remain) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   if (ModbusDiag.full)
+      n = MB_DIAG_LOG;
+   else
+      n = ModbusDiag.head;
+
+   if (!ModbusRspBegin(8 + n))
+      return;
+   ModbusPut(modbus_rx.func);
+   ModbusPut(6 + n);
+   ModbusPut(0);
+   ModbusPut(0);
+   ModbusPut(make8(ModbusDiag.events,1));
+   ModbusPut(make8(ModbusDiag.events,0));
+   ModbusPut(make8(ModbusDiag.bus_msg,1));
+   ModbusPut(make8(ModbusDiag.bus_msg,0));
+   i = ModbusDiag.head;
+   while (n--) {
+      i = (i - 1) & (MB_DIAG_LOG - 1);
+      ModbusPut(ModbusDiag.log[i]);
+   }
+}
+
+/*********************************************************************
+ * Function:        void ModbusDiagServe(void)
+ *
+ * PreCondition:    modbus_rx holds an FC8, FC11 or FC12 request to a
+ *                  local slave.
+ *
+ * Overview:        Answers the request from ModbusDiag.
+ ********************************************************************/
+void ModbusDiagServe(void) {
+   if (modbus_rx.func == FUNC_DIAGNOSTICS)
+      ModbusDiagnostics();
+   else if (modbus_rx.func == FUNC_GET_COMM_EVENT_COUNTER)
+      ModbusCommEventCounter();
+   else
+      ModbusCommEventLog();
+}
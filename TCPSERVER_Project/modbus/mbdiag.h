@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbdiag.h - Modbus diagnostics: FC8 counters, FC11/FC12 event log.
+//
+// The counters and the event log sit together in ModbusDiag.  The request
+// path only increments a counter with ModbusDiagCount() or stores one
+// byte into the log ring with ModbusDiagEvent(), so keeping them costs a
+// few instructions per request.  FC8, FC11 and FC12 are answered straight
+// from ModbusDiag.
+//
+// The counters run from the restart or the last clear:
+//
+//    FC8/0B bus message count           requests framed
+//    FC8/0C bus communication errors    requests that could not be framed
+//    FC8/0D bus exception errors        exception replies sent
+//    FC8/0E server message count        requests to a local slave
+//    FC8/0F server no response count    requests whose reply did not fit
+//    FC8/10 server NAK count            always 0
+//    FC8/11 server busy count           requests the gateway could not take
+//    FC8/12 bus character overrun       requests lost to a full buffer
+//
+// and FC11 counts the requests completed without an exception, FC11 and
+// FC12 themselves not included.  The log keeps the last MB_DIAG_LOG events in
+// the encoding of the Modbus specification: a receive event for each
+// request framed, a send event for each reply.  FC8/00 echoes the request
+// data, FC8/01 clears everything, the log too if the data is FF00, FC8/02
+// returns ModbusDiag.reg, which the application may set, FC8/0A clears
+// the counters and FC8/14 the overrun counter.
+//
+// Define MODBUS_DIAG to enable them.  Without it the counting macros are
+// empty and FC8, FC11 and FC12 are refused.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBDIAG_H
+#define MBDIAG_H
+
+// Log entries, a power of 2
+#define MB_DIAG_LOG        64
+
+// Events, see the FC12 description of the Modbus specification
+#define MB_EV_RECEIVE      0x80     // request received
+#define MB_EV_RX_ERROR     0x02     //  could not be framed
+#define MB_EV_RX_OVERRUN   0x10     //  lost to a full buffer
+#define MB_EV_SEND         0x40     // reply sent
+#define MB_EV_TX_READ_EXC  0x01     //  exception 1-3
+#define MB_EV_TX_ABORT_EXC 0x02     //  exception 4
+#define MB_EV_TX_BUSY_EXC  0x04     //  exception 5-6
+#define MB_EV_TX_NAK_EXC   0x08     //  exception 7
+#define MB_EV_RESTART      0x00     // communications restarted
+
+typedef struct _MODBUS_DIAG_INFO {
+   int16 reg;                    // diagnostic register, FC8/02
+   int16 bus_msg;                // FC8/0B..FC8/12, in this order
+   int16 bus_err;
+   int16 bus_exc;
+   int16 srv_msg;
+   int16 srv_noresp;
+   int16 srv_nak;
+   int16 srv_busy;
+   int16 overrun;
+   int16 events;                 // FC11 event counter
+   BYTE  head;                   // next log entry
+   int1  full;                   // the log has wrapped
+   BYTE  log[MB_DIAG_LOG];
+} MODBUS_DIAG_INFO;
+
+#ifdef MODBUS_DIAG
+ MODBUS_DIAG_INFO ModbusDiag;
+
+ #define ModbusDiagCount(counter)   ModbusDiag.counter++
+ #define ModbusDiagEvent(ev) do { \
+    ModbusDiag.log[ModbusDiag.head] = (ev); \
+    ModbusDiag.head = (ModbusDiag.head + 1) & (MB_DIAG_LOG - 1); \
+    if (!ModbusDiag.head) \
+       ModbusDiag.full = TRUE; \
+ } while (0)
+
+ void ModbusDiagServe(void);
+#else
+ #define ModbusDiagCount(counter)
+ #define ModbusDiagEvent(ev)
+#endif
+
+#endif
@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbeeprom.c - Holding registers kept in the data EEPROM, see mbeeprom.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbeeprom.h"
+
+#byte ModbusEEADRH = getenv("SFR:EEADRH")
+#byte ModbusEEADR  = getenv("SFR:EEADR")
+#byte ModbusEEDATA = getenv("SFR:EEDATA")
+#byte ModbusEECON2 = getenv("SFR:EECON2")
+#bit ModbusEEPGD   = getenv("BIT:EEPGD")
+#bit ModbusEECFGS  = getenv("BIT:CFGS")
+#bit ModbusEEWREN  = getenv("BIT:WREN")
+#bit ModbusEEWR    = getenv("BIT:WR")
+#bit ModbusEEGIE   = getenv("BIT:GIE")
+
+// ModbusEeRange[]: the ranges kept, closed by an entry with count 0
+#define MB_EE_ENTRY(i,n)   {i, n},
+
+const MODBUS_EE_RANGE ModbusEeRange[] = {
+   MODBUS_EEPROM(MB_EE_ENTRY)
+   {0, 0}
+};
+
+BYTE ModbusEeSlot[MB_EE_BLOCKS];    // newest record of each block, or MB_EE_NONE
+BYTE ModbusEeSeq[MB_EE_BLOCKS];     // its sequence number
+int16 ModbusEeSum[MB_EE_BLOCKS];    // sum of the registers when last looked at
+TICKTYPE ModbusEeSince[MB_EE_BLOCKS]; // since when they have that sum
+
+// The block ModbusEETask() looks at next
+static BYTE ModbusEeBlock;          // number, for ModbusEeSlot[]
+static BYTE ModbusEeRng;            // range it belongs to
+static int16 ModbusEeReg;           // its first register within the range
+
+// The record being written
+static BYTE ModbusEeBuf[MB_EE_REC];
+static int16 ModbusEeAddr;          // EEPROM address of ModbusEeBuf[0]
+static BYTE ModbusEePos;            // next byte, MB_EE_REC when done
+
+//EEPROM address of slot of the block
+#define ModbusEERecAddr(block, slot) \
+   (((int16)(block) * MODBUS_EEPROM_SLOTS + (slot)) * MB_EE_REC)
+
+//registers of the block at register reg of range r
+static BYTE ModbusEEBlockRegs(BYTE r, int16 reg) {
+   if (ModbusEeRange[r].count - reg < MODBUS_EEPROM_BLOCK)
+      return(ModbusEeRange[r].count - reg);
+   return(MODBUS_EEPROM_BLOCK);
+}
+
+//steps on to the next block, back to the first after the last
+static void ModbusEENextBlock(void) {
+   ModbusEeReg += MODBUS_EEPROM_BLOCK;
+   ModbusEeBlock++;
+   if (ModbusEeReg >= ModbusEeRange[ModbusEeRng].count) {
+      ModbusEeReg = 0;
+      ModbusEeRng++;
+      if (!ModbusEeRange[ModbusEeRng].count) {
+         ModbusEeRng = 0;
+         ModbusEeBlock = 0;
+      }
+   }
+}
+
+//Fletcher sum of the n bytes of registers from storage index idx on
+static int16 ModbusEESum(int16 idx, BYTE n) {
+   BYTE i, a, b;
+
+   a = 0;
+   b = 0;
+   for (i=0;i<n;i++) {
+      a += hold_regs[idx * 2 + i];
+      b += a;
+   }
+   return(make16(b, a));
+}
+
+//TRUE if the record at addr passes its check, its sequence number in *seq
+static BOOL ModbusEEValid(int16 addr, BYTE *seq) {
+   BYTE i, sum;
+
+   sum = 0;
+   for (i=0;i<MB_EE_REC-1;i++)
+      sum += read_eeprom(addr + i);
+   *seq = read_eeprom(addr + MB_EE_REC - 2);
+   return(read_eeprom(addr + MB_EE_REC - 1) == (BYTE)~sum);
+}
+
+//starts writing val to the EEPROM at addr, the caller checked that no
+//write is in progress.  interrupts are left as they were found.
+static void ModbusEEWrite(int16 addr, BYTE val) {
+   int1 gie;
+
+   ModbusEEADRH = make8(addr,1);
+   ModbusEEADR = make8(addr,0);
+   ModbusEEDATA = val;
+   ModbusEEPGD = 0;
+   ModbusEECFGS = 0;
+   ModbusEEWREN = 1;
+   gie = ModbusEEGIE;
+   disable_interrupts(GLOBAL);
+   ModbusEECON2 = 0x55;
+   ModbusEECON2 = 0xAA;
+   ModbusEEWR = 1;
+   if (gie)
+      enable_interrupts(GLOBAL);
+   ModbusEEWREN = 0;
+}
+
+/*********************************************************************
+ * Function:        void ModbusEEInit(void)
+ *
+ * Overview:        Loads the newest valid record of every block kept
+ *                  into the holding registers.  Blocks without one
+ *                  keep their values and are written by ModbusEETask()
+ *                  once MODBUS_EEPROM_HOLD ticks have passed.
+ ********************************************************************/
+void ModbusEEInit(void) {
+   BYTE s, seq, n, i;
+   int16 addr, idx;
+
+   ModbusEeBlock = 0;
+   ModbusEeRng = 0;
+   ModbusEeReg = 0;
+   ModbusEePos = MB_EE_REC;
+
+   do {
+      ModbusEeSlot[ModbusEeBlock] = MB_EE_NONE;
+      for (s=0;s<MODBUS_EEPROM_SLOTS;s++) {
+         if (!ModbusEEValid(ModbusEERecAddr(ModbusEeBlock, s), &seq))
+            continue;
+         //sequence numbers wrap, newer is ahead by less than half the range
+         if (ModbusEeSlot[ModbusEeBlock] == MB_EE_NONE ||
+             (signed int8)(seq - ModbusEeSeq[ModbusEeBlock]) > 0) {
+            ModbusEeSlot[ModbusEeBlock] = s;
+            ModbusEeSeq[ModbusEeBlock] = seq;
+         }
+      }
+
+      if (ModbusEeSlot[ModbusEeBlock] != MB_EE_NONE) {
+         addr = ModbusEERecAddr(ModbusEeBlock, ModbusEeSlot[ModbusEeBlock]);
+         idx = ModbusEeRange[ModbusEeRng].index + ModbusEeReg;
+         n = ModbusEEBlockRegs(ModbusEeRng, ModbusEeReg);
+         for (i=0;i<n*2;i++)
+            hold_regs[idx * 2 + i] = read_eeprom(addr + i);
+         ModbusRegsDirty(hold_dirty, idx, n);
+      }
+      idx = ModbusEeRange[ModbusEeRng].index + ModbusEeReg;
+      n = ModbusEEBlockRegs(ModbusEeRng, ModbusEeReg);
+      ModbusEeSum[ModbusEeBlock] = ModbusEESum(idx, n * 2);
+      ModbusEeSince[ModbusEeBlock] = TickGet();
+      ModbusEENextBlock();
+   } while (ModbusEeBlock);
+}
+
+/*********************************************************************
+ * Function:        void ModbusEETask(void)
+ *
+ * PreCondition:    ModbusEEInit() was called.
+ *
+ * Overview:        Starts writing the next byte of the record being
+ *                  written.  Otherwise compares the next block with its
+ *                  newest record, and if they differ and the block has
+ *                  not changed for MODBUS_EEPROM_HOLD ticks, stages a
+ *                  new record of it for the next slot.
+ *
+ * Note:            Returns at once while the EEPROM is busy, so call it
+ *                  from the main loop as often as convenient.
+ ********************************************************************/
+void ModbusEETask(void) {
+   BYTE i, n, slot, sum;
+   int16 addr, idx, check;
+   BOOL dirty;
+
+   if (ModbusEEWR)
+      return;                       //last byte still being written
+
+   while (ModbusEePos < MB_EE_REC) {
+      addr = ModbusEeAddr + ModbusEePos;
+      i = ModbusEeBuf[ModbusEePos++];
+      if (read_eeprom(addr) != i) {
+         ModbusEEWrite(addr, i);
+         return;
+      }
+   }
+
+   idx = ModbusEeRange[ModbusEeRng].index + ModbusEeReg;
+   n = ModbusEEBlockRegs(ModbusEeRng, ModbusEeReg) * 2;
+   slot = ModbusEeSlot[ModbusEeBlock];
+   dirty = TRUE;
+   if (slot != MB_EE_NONE) {
+      addr = ModbusEERecAddr(ModbusEeBlock, slot);
+      for (i=0;i<n;i++) {
+         if (hold_regs[idx * 2 + i] != read_eeprom(addr + i))
+            break;
+      }
+      dirty = (i < n);
+   }
+
+   //a block still changing waits until it is left alone
+   if (dirty) {
+      check = ModbusEESum(idx, n);
+      if (check != ModbusEeSum[ModbusEeBlock]) {
+         ModbusEeSum[ModbusEeBlock] = check;
+         ModbusEeSince[ModbusEeBlock] = TickGet();
+         dirty = FALSE;
+      }
+      else if (TickGetDiff(TickGet(), ModbusEeSince[ModbusEeBlock]) < MODBUS_EEPROM_HOLD) {
+         dirty = FALSE;
+      }
+   }
+
+   if (dirty) {
+      //the record is copied out first, so it holds one consistent image
+      //however long the writes take
+      memset(ModbusEeBuf, 0, MB_EE_REC);
+      memcpy(ModbusEeBuf, &hold_regs[idx * 2], n);
+      if (slot == MB_EE_NONE || ++slot == MODBUS_EEPROM_SLOTS)
+         slot = 0;
+      ModbusEeBuf[MB_EE_REC - 2] = ++ModbusEeSeq[ModbusEeBlock];
+      sum = 0;
+      for (i=0;i<MB_EE_REC-1;i++)
+         sum += ModbusEeBuf[i];
+      ModbusEeBuf[MB_EE_REC - 1] = ~sum;
+      ModbusEeSlot[ModbusEeBlock] = slot;
+      ModbusEeAddr = ModbusEERecAddr(ModbusEeBlock, slot);
+      ModbusEePos = 0;
+   }
+   ModbusEENextBlock();
+}
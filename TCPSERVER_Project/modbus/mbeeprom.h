@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbeeprom.h - Holding registers kept in the data EEPROM.
+//
+// Setpoints written by a master must survive a power loss, but a data
+// EEPROM byte takes about 4ms to write.  The registers in RAM therefore
+// stay authoritative and requests never touch the EEPROM: ModbusEETask(),
+// called from the main loop, writes the changes back in the background,
+// starting one byte per call and never waiting for the write to finish.
+//
+// The registers kept are listed in MODBUS_EEPROM, one X(index, count) per
+// range of holding registers, index being the storage index of the first
+// one (see MB_INDEX in mbmap.h).  Each range is cut into blocks of
+// MODBUS_EEPROM_BLOCK registers, and every block owns MODBUS_EEPROM_SLOTS
+// records in the EEPROM:
+//
+//    data(2 x MODBUS_EEPROM_BLOCK), sequence(1), check(1)
+//
+// check being the complement of the sum of the bytes before it.  A block
+// whose registers differ from its newest record is written to the next
+// slot in turn with the sequence number one up, check last.  Writes thus
+// rotate over all slots of the block, which spreads the wear, and a write
+// cut short by a power loss leaves a record that fails its check, so the
+// one before it still counts.  Bytes that already hold the right value are
+// not written again.  A block is only written once its registers have not
+// changed for MODBUS_EEPROM_HOLD ticks, so a setpoint a master ramps up
+// costs one record and not one per step.
+//
+// ModbusEEInit() loads the newest valid record of each block into the
+// holding registers, so call it after the registers got their defaults and
+// before requests are served.  For example:
+//
+//  #define MODBUS_EEPROM(X) \
+//     X(0, 16) \
+//     X(40, 8)
+//
+// The records must fit the data EEPROM of the device.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBEEPROM_H
+#define MBEEPROM_H
+
+#include "modbus/modbus.h"
+
+// Registers per block
+#ifndef MODBUS_EEPROM_BLOCK
+ #define MODBUS_EEPROM_BLOCK  8
+#endif
+
+// Records per block the writes rotate over
+#ifndef MODBUS_EEPROM_SLOTS
+ #define MODBUS_EEPROM_SLOTS  4
+#endif
+
+// Ticks a block must stay unchanged before it is written
+#ifndef MODBUS_EEPROM_HOLD
+ #define MODBUS_EEPROM_HOLD   (TICKS_PER_SECOND * 2)
+#endif
+
+#define MB_EE_REC          (MODBUS_EEPROM_BLOCK * 2 + 2)
+#define MB_EE_OF(i,n)      + ((n) + MODBUS_EEPROM_BLOCK - 1) / MODBUS_EEPROM_BLOCK
+#define MB_EE_BLOCKS       (0 MODBUS_EEPROM(MB_EE_OF))
+
+#if MODBUS_EEPROM_SLOTS < 2
+ #error A block needs two records, so a cut write leaves the older one
+#endif
+#if MB_EE_BLOCKS * MODBUS_EEPROM_SLOTS * MB_EE_REC > getenv("DATA_EEPROM")
+ #error The register records do not fit the data EEPROM
+#endif
+
+#define MB_EE_NONE         0xFF     // block without a valid record
+
+typedef struct _MODBUS_EE_RANGE {
+   int16 index;
+   int16 count;                  // 0 closes the list
+} MODBUS_EE_RANGE;
+
+void ModbusEEInit(void);
+void ModbusEETask(void);
+
+#endif
@@ -0,0 +1,467 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbgw.c - Modbus TCP to RTU gateway, see mbgw.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbgw.h"
+
+// FIFO entry: conn, epoch, socket, tid(2), unit, PDU length, then the PDU
+#define MB_GW_HDR_LEN   7
+#define MB_GW_DONE      0xFF  // conn of an entry or peer that needs nothing more
+
+// Transaction states
+#define MB_GW_IDLE      0
+#define MB_GW_WAIT      1     // request sent, waiting for the reply
+#define MB_GW_REPLY     2     // reply (or exception) ready for the masters
+
+#if MODBUS_GW_QUEUE & (MODBUS_GW_QUEUE - 1)
+ #error MODBUS_GW_QUEUE must be a power of 2
+#endif
+#if MODBUS_GW_QUEUE < MB_GW_HDR_LEN + MODBUS_RTU_PDU_MAX
+ #error MODBUS_GW_QUEUE must hold a request of the largest PDU
+#endif
+
+// The FIFO is a ring.  The indexes run on freely and are masked on every
+// access, so In - Out is the number of bytes queued.
+BYTE ModbusGwQueue[MODBUS_GW_QUEUE];
+int16 ModbusGwIn, ModbusGwOut;
+
+// Position of index p in the ring
+#define MB_GW_AT(p)     ((p) & (MODBUS_GW_QUEUE - 1))
+
+// Byte i of the entry at p
+#define MB_GW_Q(p, i)   ModbusGwQueue[MB_GW_AT((p) + (i))]
+
+// Functions that change nothing on the slave
+#define MB_GW_IS_READ(f)   ((f) >= FUNC_READ_COILS && (f) <= FUNC_READ_INPUT_REGISTERS)
+
+static MODBUS_GW_TRANS ModbusGwTrans;
+static BYTE ModbusGwState = MB_GW_IDLE;
+static BYTE ModbusGwError;    // exception to answer with, 0 to relay
+
+//adds the master of the FIFO entry header hdr to those waiting for the
+//transaction's reply
+static void ModbusGatewayAddPeer(BYTE *hdr, int16 addr, BYTE qty) {
+   MODBUS_GW_PEER *p;
+
+   p = &ModbusGwTrans.peer[ModbusGwTrans.peers++];
+   p->conn = hdr[0];
+   p->epoch = hdr[1];
+   p->socket = hdr[2];
+   p->tid[0] = hdr[3];
+   p->tid[1] = hdr[4];
+   p->addr = addr;
+   p->qty = qty;
+}
+
+//TRUE if a read of qty registers at addr can be coalesced into the read
+//being sent, which then grows to cover both
+static BOOL ModbusGatewayJoin(int16 addr, int16 qty) {
+   int16 start, end;
+
+   if (qty == 0 || qty > MODBUS_MAX_READ_REGS || addr + qty < addr)
+      return(FALSE);
+
+   //only overlapping or adjoining ranges, a gap may hold addresses the
+   //slave refuses
+   end = ModbusGwTrans.addr + ModbusGwTrans.qty;
+   if (addr > end || addr + qty < ModbusGwTrans.addr)
+      return(FALSE);
+
+   start = ModbusGwTrans.addr;
+   if (addr < start)
+      start = addr;
+   if (addr + qty > end)
+      end = addr + qty;
+   if (end - start > MODBUS_MAX_READ_REGS)
+      return(FALSE);
+
+   ModbusGwTrans.addr = start;
+   ModbusGwTrans.qty = end - start;
+   return(TRUE);
+}
+
+//TRUE if the FIFO entry at p is from a master that is still connected
+static BOOL ModbusGatewayLive(int16 p) {
+   return(MB_GW_Q(p,0) != MB_GW_DONE &&
+          MB_GW_Q(p,1) == ModbusConn[MB_GW_Q(p,0)].epoch);
+}
+
+//TRUE if a request that may change unit is waiting in the FIFO
+static BOOL ModbusGatewayWriteQueued(BYTE unit) {
+   int16 p;
+
+   for (p=ModbusGwOut;p!=ModbusGwIn;p+=MB_GW_HDR_LEN + MB_GW_Q(p,6)) {
+      if (ModbusGatewayLive(p) && MB_GW_Q(p,5) == unit &&
+          !MB_GW_IS_READ(MB_GW_Q(p,7)))
+         return(TRUE);
+   }
+   return(FALSE);
+}
+
+#ifdef MODBUS_GW_CACHE
+//drops the cached registers the request in the FIFO entry at p may write
+static void ModbusGatewayInvalidate(int16 p) {
+   BYTE func, len;
+   int16 addr, qty;
+
+   func = MB_GW_Q(p,7);
+   if (MB_GW_IS_READ(func))
+      return;
+   len = MB_GW_Q(p,6);
+   addr = make16(MB_GW_Q(p,8), MB_GW_Q(p,9));
+   qty = 0;                      //unknown extent, forget the whole unit
+   if ((func == FUNC_WRITE_SINGLE_REGISTER || func == FUNC_MASK_WRITE_REGISTER) &&
+       len >= 3) {
+      qty = 1;
+   }
+   else if (func == FUNC_WRITE_MULTIPLE_REGISTERS && len >= 5) {
+      qty = make16(MB_GW_Q(p,10), MB_GW_Q(p,11));
+   }
+   else if (func == FUNC_READ_WRITE_MULTIPLE_REGISTERS && len >= 9) {
+      addr = make16(MB_GW_Q(p,12), MB_GW_Q(p,13));
+      qty = make16(MB_GW_Q(p,14), MB_GW_Q(p,15));
+   }
+   else if (func == FUNC_WRITE_SINGLE_COIL || func == FUNC_WRITE_MULTIPLE_COILS) {
+      return;
+   }
+   ModbusCacheInvalidate(MB_GW_Q(p,5), addr, qty);
+}
+#endif
+
+/*********************************************************************
+ * Function:        BOOL ModbusGatewayQueue(void)
+ *
+ * PreCondition:    Called by ModbusServe() with modbus_rx.func read.
+ *
+ * Output:          TRUE if the request was queued or answered, FALSE
+ *                  if it does not fit into the FIFO, or came in a UDP
+ *                  datagram and is not answered from the cache.
+ *
+ * Overview:        Copies the request into the FIFO for the RTU line.
+ *                  The PDU moves in at most two bursts, one on each
+ *                  side of the end of the ring.  A read whose range is
+ *                  cached and fresh is answered right away.  A read
+ *                  covered by the read on the line is not queued, it
+ *                  waits for that read's reply.
+ ********************************************************************/
+BOOL ModbusGatewayQueue(void) {
+   BYTE hdr[MB_GW_HDR_LEN];
+   BYTE req[4];
+  #ifdef MODBUS_GW_CACHE
+   int16 p;
+  #endif
+   int16 len, n, addr, qty;
+   int1 read;
+
+   len = modbus_rx.remain + 1;
+   if (len > MODBUS_RTU_PDU_MAX)
+      return(FALSE);
+
+   hdr[0] = modbus_rx.conn;
+   hdr[1] = ModbusConn[modbus_rx.conn].epoch;
+   hdr[2] = modbus_rx.socket;
+   hdr[3] = modbus_rx.mbap[0];
+   hdr[4] = modbus_rx.mbap[1];
+   hdr[5] = modbus_rx.mbap[6];
+   hdr[6] = len;
+
+   read = (modbus_rx.func == FUNC_READ_HOLDING_REGISTERS ||
+           modbus_rx.func == FUNC_READ_INPUT_REGISTERS) && len == 5;
+   if (read) {
+      ModbusGetArray(req, 4);
+      addr = make16(req[0], req[1]);
+      qty = make16(req[2], req[3]);
+     #ifdef MODBUS_GW_CACHE
+      //a queued write may change the cached registers any moment
+      if (!ModbusGatewayWriteQueued(hdr[5]) &&
+          ModbusCacheRead(hdr[5], addr, qty))
+         return(TRUE);
+     #endif
+   }
+
+  #ifdef MODBUS_UDP
+   //a datagram has no connection to relay the reply to later
+   if (modbus_rx.udp)
+      return(FALSE);
+  #endif
+
+   if (read && ModbusGwState == MB_GW_WAIT && ModbusGwTrans.merged &&
+       ModbusGwTrans.unit == hdr[5] && ModbusGwTrans.func == modbus_rx.func &&
+       ModbusGwTrans.peers < MODBUS_GW_PEERS && qty &&
+       addr >= ModbusGwTrans.addr &&
+       addr + qty <= ModbusGwTrans.addr + ModbusGwTrans.qty &&
+       !ModbusGatewayWriteQueued(hdr[5])) {
+      ModbusGatewayAddPeer(hdr, addr, qty);
+      return(TRUE);
+   }
+
+   if (MODBUS_GW_QUEUE - (ModbusGwIn - ModbusGwOut) < MB_GW_HDR_LEN + len)
+      return(FALSE);
+
+  #ifdef MODBUS_GW_CACHE
+   p = ModbusGwIn;
+  #endif
+   for (n=0;n<MB_GW_HDR_LEN;n++)
+      MB_GW_Q(ModbusGwIn++, 0) = hdr[n];
+   MB_GW_Q(ModbusGwIn++, 0) = modbus_rx.func;
+
+   if (read) {
+      for (n=0;n<4;n++)
+         MB_GW_Q(ModbusGwIn++, 0) = req[n];
+      return(TRUE);
+   }
+
+   n = MODBUS_GW_QUEUE - MB_GW_AT(ModbusGwIn);
+   if (n > modbus_rx.remain)
+      n = modbus_rx.remain;
+   ModbusGetArray(&MB_GW_Q(ModbusGwIn, 0), n);
+   ModbusGwIn += n;
+   n = modbus_rx.remain;
+   ModbusGetArray(&MB_GW_Q(ModbusGwIn, 0), n);
+   ModbusGwIn += n;
+
+   //reads from now on must not see the old values
+  #ifdef MODBUS_GW_CACHE
+   ModbusGatewayInvalidate(p);
+  #endif
+   return(TRUE);
+}
+
+//coalesces the queued reads from entry p on into the read being sent,
+//up to the first request that may change the slave
+static void ModbusGatewayCoalesce(int16 p) {
+   BYTE hdr[MB_GW_HDR_LEN];
+   BYTE i;
+
+   while (p != ModbusGwIn && ModbusGwTrans.peers < MODBUS_GW_PEERS) {
+      if (ModbusGatewayLive(p) && MB_GW_Q(p,5) == ModbusGwTrans.unit &&
+          !MB_GW_IS_READ(MB_GW_Q(p,7)))
+         break;
+      if (ModbusGatewayLive(p) && MB_GW_Q(p,5) == ModbusGwTrans.unit &&
+          MB_GW_Q(p,6) == 5 && MB_GW_Q(p,7) == ModbusGwTrans.func &&
+          ModbusGatewayJoin(make16(MB_GW_Q(p,8), MB_GW_Q(p,9)),
+                            make16(MB_GW_Q(p,10), MB_GW_Q(p,11)))) {
+         for (i=0;i<MB_GW_HDR_LEN;i++)
+            hdr[i] = MB_GW_Q(p,i);
+         ModbusGatewayAddPeer(hdr, make16(MB_GW_Q(p,8), MB_GW_Q(p,9)),
+                              MB_GW_Q(p,11));
+         MB_GW_Q(p,0) = MB_GW_DONE;    //answered with this read
+      }
+      p += MB_GW_HDR_LEN + MB_GW_Q(p,6);
+   }
+}
+
+#ifdef MODBUS_GW_CACHE
+//grows the read being sent to the whole cached range holding addr, if
+//the result stays a legal read
+static void ModbusGatewayWiden(int16 addr) {
+   BYTE i;
+
+   i = ModbusCacheFind(ModbusGwTrans.unit, ModbusGwTrans.func, addr);
+   if (i != MB_NO_RANGE)
+      ModbusGatewayJoin(ModbusCacheRange[i].start, ModbusCacheRange[i].count);
+}
+#endif
+
+//sends the oldest queued request of a master that is still connected.
+//returns FALSE if there is none.
+static BOOL ModbusGatewayNext(void) {
+   BYTE hdr[MB_GW_HDR_LEN];
+   BYTE i, len;
+   int16 addr, qty;
+
+   while (ModbusGwIn != ModbusGwOut) {
+      if (!ModbusGatewayLive(ModbusGwOut)) {
+         ModbusGwOut += MB_GW_HDR_LEN + MB_GW_Q(ModbusGwOut,6);
+         continue;
+      }
+      for (i=0;i<MB_GW_HDR_LEN;i++)
+         hdr[i] = MB_GW_Q(ModbusGwOut++, 0);
+      len = hdr[6];
+
+      ModbusGwTrans.unit = hdr[5];
+      ModbusGwTrans.func = MB_GW_Q(ModbusGwOut, 0);
+      ModbusGwTrans.peers = 0;
+      ModbusGwTrans.merged = FALSE;
+      if (len == 5 && (ModbusGwTrans.func == FUNC_READ_HOLDING_REGISTERS ||
+                       ModbusGwTrans.func == FUNC_READ_INPUT_REGISTERS)) {
+         addr = make16(MB_GW_Q(ModbusGwOut,1), MB_GW_Q(ModbusGwOut,2));
+         qty = make16(MB_GW_Q(ModbusGwOut,3), MB_GW_Q(ModbusGwOut,4));
+         ModbusGwTrans.addr = addr;
+         ModbusGwTrans.qty = 0;
+         ModbusGwTrans.merged = ModbusGatewayJoin(addr, qty);
+      }
+
+      ModbusRTUPut(ModbusGwTrans.unit);
+      if (ModbusGwTrans.merged) {
+         //the first join set the read to this master's range
+         ModbusGatewayAddPeer(hdr, ModbusGwTrans.addr, ModbusGwTrans.qty);
+         ModbusGwOut += len;
+         ModbusGatewayCoalesce(ModbusGwOut);
+        #ifdef MODBUS_GW_CACHE
+         //widen the read to whole cached ranges, so the reply refreshes them
+         ModbusGatewayWiden(ModbusGwTrans.addr);
+         ModbusGatewayWiden(ModbusGwTrans.addr + ModbusGwTrans.qty - 1);
+        #endif
+         ModbusRTUPut(ModbusGwTrans.func);
+         ModbusRTUPut(make8(ModbusGwTrans.addr,1));
+         ModbusRTUPut(make8(ModbusGwTrans.addr,0));
+         ModbusRTUPut(0);
+         ModbusRTUPut(ModbusGwTrans.qty);
+      }
+      else {
+         ModbusGatewayAddPeer(hdr, 0, 0);
+        #ifdef MODBUS_GW_CACHE
+         //a read that went out before may have cached the old values
+         ModbusGatewayInvalidate(ModbusGwOut - MB_GW_HDR_LEN);
+        #endif
+         while (len--)
+            ModbusRTUPut(MB_GW_Q(ModbusGwOut++, 0));
+      }
+      ModbusRTUSend();
+      ModbusGwTrans.start = TickGet();
+      return(TRUE);
+   }
+   return(FALSE);
+}
+
+//TRUE if the received frame is the answer to the transaction
+static BOOL ModbusGatewayMatch(void) {
+   if (!ModbusRTUFrameValid() ||
+       ModbusRTUPeek(0) != ModbusGwTrans.unit ||
+       (ModbusRTUPeek(1) & 0x7F) != ModbusGwTrans.func)
+      return(FALSE);
+
+   //a coalesced read is split up, it must hold every register asked for
+   if (ModbusGwTrans.merged && !(ModbusRTUPeek(1) & 0x80))
+      return(ModbusRTUPeek(2) == ModbusGwTrans.qty * 2 &&
+             ModbusRTUFrameLen() == 5 + ModbusGwTrans.qty * 2);
+   return(TRUE);
+}
+
+//passes the reply, or the exception in its place, on to one master.
+//returns FALSE while its socket can not take it yet.
+static BOOL ModbusGatewayAnswer(MODBUS_GW_PEER *p) {
+   int16 len, i, first;
+   BOOL slice;
+
+   //the PDU: an exception, this master's slice of a coalesced read, or
+   //what sits between the unit id and the CRC
+   slice = FALSE;
+   if (ModbusGwError)
+      len = 2;
+   else if (ModbusGwTrans.merged && !(ModbusRTUPeek(1) & 0x80)) {
+      slice = TRUE;
+      len = 2 + p->qty * 2;
+   }
+   else
+      len = ModbusRTUFrameLen() - 3;
+
+   if (!TCPIsPutReady(p->socket) ||
+       TCPPutAvailable(p->socket) < MODBUS_MBAP_LEN + len)
+      return(FALSE);
+
+   modbus_rx.mbap[0] = p->tid[0];
+   modbus_rx.mbap[1] = p->tid[1];
+   modbus_rx.mbap[2] = 0;
+   modbus_rx.mbap[3] = 0;
+   modbus_rx.mbap[6] = ModbusGwTrans.unit;
+   modbus_rx.func = ModbusGwTrans.func;
+   modbus_rx.socket = p->socket;
+   modbus_rx.udp = FALSE;
+
+   if (ModbusGwError) {
+      ModbusException(ModbusGwError);
+   }
+   else if (slice) {
+      len -= 2;
+      first = 3 + (p->addr - ModbusGwTrans.addr) * 2;
+      if (ModbusRspBegin(2 + len)) {
+         MACPut(modbus_rx.func);
+         MACPut(len);
+         for (i=0;i<len;i++)
+            MACPut(ModbusRTUPeek(first + i));
+      }
+   }
+   else {
+      if (ModbusRspBegin(len)) {
+         for (i=1;i<=len;i++)
+            MACPut(ModbusRTUPeek(i));
+      }
+   }
+   TCPFlush(p->socket);
+   return(TRUE);
+}
+
+//answers every master waiting for the transaction.  returns TRUE once
+//all are answered, gone, or have not freed their socket in time.
+static BOOL ModbusGatewayReply(void) {
+   MODBUS_GW_PEER *p;
+   BOOL expired, done;
+   BYTE i;
+
+   expired = TickGetDiff(TickGet(), ModbusGwTrans.start) > MODBUS_GW_TIMEOUT;
+   done = TRUE;
+   for (i=0;i<ModbusGwTrans.peers;i++) {
+      p = &ModbusGwTrans.peer[i];
+      if (p->conn == MB_GW_DONE)
+         continue;
+      if (expired || p->epoch != ModbusConn[p->conn].epoch ||
+          ModbusGatewayAnswer(p))
+         p->conn = MB_GW_DONE;
+      else
+         done = FALSE;
+   }
+   return(done);
+}
+
+/*********************************************************************
+ * Function:        void ModbusGatewayTask(void)
+ *
+ * PreCondition:    ModbusRTUInit() was called.
+ *
+ * Overview:        Runs the RTU transaction one step.  Call it from
+ *                  the main loop, it never waits for the serial line.
+ ********************************************************************/
+void ModbusGatewayTask(void) {
+   switch (ModbusGwState) {
+      case MB_GW_IDLE:
+         if (ModbusGatewayNext())
+            ModbusGwState = MB_GW_WAIT;
+         break;
+
+      case MB_GW_WAIT:
+         if (ModbusRTUFrameReady()) {
+            if (ModbusGatewayMatch()) {
+              #ifdef MODBUS_GW_CACHE
+               //the reply may predate a write queued meanwhile
+               if (ModbusGwTrans.merged && !(ModbusRTUPeek(1) & 0x80) &&
+                   !ModbusGatewayWriteQueued(ModbusGwTrans.unit))
+                  ModbusCacheFill(ModbusGwTrans.unit, ModbusGwTrans.func,
+                                  ModbusGwTrans.addr, ModbusGwTrans.qty);
+              #endif
+               ModbusGwError = 0;
+               ModbusGwTrans.start = TickGet();
+               ModbusGwState = MB_GW_REPLY;
+            }
+            else {
+               ModbusRTUDiscard();     //noise or a late reply, keep waiting
+            }
+         }
+         else if (TickGetDiff(TickGet(), ModbusGwTrans.start) > MODBUS_GW_TIMEOUT) {
+            ModbusGwError = GATEWAY_TARGET_NO_RESPONSE;
+            ModbusGwTrans.start = TickGet();
+            ModbusGwState = MB_GW_REPLY;
+         }
+         break;
+
+      case MB_GW_REPLY:
+         if (ModbusGatewayReply()) {
+            ModbusRTUDiscard();
+            ModbusGwState = MB_GW_IDLE;
+         }
+         break;
+   }
+}
@@ -0,0 +1,82 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbgw.h - Modbus TCP to RTU gateway.
+//
+// With MODBUS_GATEWAY defined, requests for unit ids that no local slave
+// answers to (see MODBUS_UNITS in mbmap.h) are passed on to the RTU line.
+// The engine copies such a request into a FIFO and goes on with the next
+// one, it never waits for the serial line.  ModbusGatewayTask(), called
+// from the main loop, sends the queued requests one at a time as RTU
+// frames, waits for the reply and relays it to the socket and transaction
+// id the request came from.
+//
+// A request that finds the FIFO full is answered with exception 0x0A.  A
+// slave that does not answer within MODBUS_GW_TIMEOUT, or answers with a
+// bad CRC, gets exception 0x0B sent in its place.  Replies for a master
+// that has disconnected in the meantime are dropped, and so are its
+// requests still in the FIFO.
+//
+// FC3 and FC4 reads are coalesced.  When a read goes out, the queued reads
+// of the same unit and table that overlap or adjoin it are merged into one
+// RTU request for the union range, up to 125 registers, and each master
+// gets its own slice of the reply.  A read that arrives while a read
+// covering its range is already on the line shares that read's answer
+// instead of being queued.  With several masters polling the same slave,
+// most polls then cost no serial transaction of their own.  Reads are
+// never moved ahead of a write queued for the same unit.
+//
+// With MODBUS_GW_CACHE defined, reads of cached ranges are answered from
+// RAM while the cached values are fresh enough, see mbcache.h.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBGW_H
+#define MBGW_H
+
+#include "modbus/mbrtu.h"
+#ifdef MODBUS_GW_CACHE
+ #include "modbus/mbcache.h"
+#endif
+
+// Reply timeout in ticks
+#ifndef MODBUS_GW_TIMEOUT
+ #define MODBUS_GW_TIMEOUT  TICKS_PER_SECOND
+#endif
+
+// FIFO of requests for the RTU line in bytes, a power of 2.  Each request
+// takes its PDU plus 7 bytes, so 512 holds at least one of any size.
+#ifndef MODBUS_GW_QUEUE
+ #define MODBUS_GW_QUEUE    512
+#endif
+
+// Most masters one coalesced read answers
+#ifndef MODBUS_GW_PEERS
+ #define MODBUS_GW_PEERS    4
+#endif
+
+// A master waiting for the reply of the transaction on the RTU line
+typedef struct _MODBUS_GW_PEER {
+   BYTE  conn;                   // transport connection, MB_GW_DONE once answered
+   BYTE  epoch;                  // ModbusConn[conn].epoch when queued
+   TCP_SOCKET socket;
+   BYTE  tid[2];                 // MBAP transaction id
+   int16 addr;                   // registers it asked for, in a coalesced read
+   BYTE  qty;
+} MODBUS_GW_PEER;
+
+// The transaction on the RTU line
+typedef struct _MODBUS_GW_TRANS {
+   BYTE  unit;
+   BYTE  func;
+   int1  merged;                 // FC3/FC4 read that may answer several peers
+   int16 addr;                   // registers read, the union of the peers'
+   BYTE  qty;
+   BYTE  peers;
+   MODBUS_GW_PEER peer[MODBUS_GW_PEERS];
+   TICKTYPE start;
+} MODBUS_GW_TRANS;
+
+BOOL ModbusGatewayQueue(void);
+void ModbusGatewayTask(void);
+
+#endif
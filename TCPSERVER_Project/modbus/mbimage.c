@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbimage.c - Double buffered register feeds, see mbimage.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbimage.h"
+
+// ModbusFeed[]: the feeds in id order
+#define MB_IMAGE_ENTRY(F,id,t,i,n)      {t, i, n},
+
+const MODBUS_FEED ModbusFeed[] = {
+   MODBUS_IMAGE(MB_IMAGE_ENTRY,0)
+};
+
+// ModbusImageOff[]: offset of feed ID in each buffer, the feeds listed
+// before it
+#define MB_IMAGE_BEFORE(ID,id,t,i,n)    + ((id) < (ID) ? (n) * 2 : 0)
+#define MB_IMAGE_OFF(ID)                (0 MODBUS_IMAGE(MB_IMAGE_BEFORE,ID))
+
+const int16 ModbusImageOff[MB_IMAGES] = {
+   MB_IMAGE_OFF(0)
+#if MB_IMAGES > 1
+   , MB_IMAGE_OFF(1)
+#endif
+#if MB_IMAGES > 2
+   , MB_IMAGE_OFF(2)
+#endif
+#if MB_IMAGES > 3
+   , MB_IMAGE_OFF(3)
+#endif
+#if MB_IMAGES > 4
+   , MB_IMAGE_OFF(4)
+#endif
+#if MB_IMAGES > 5
+   , MB_IMAGE_OFF(5)
+#endif
+#if MB_IMAGES > 6
+   , MB_IMAGE_OFF(6)
+#endif
+#if MB_IMAGES > 7
+   , MB_IMAGE_OFF(7)
+#endif
+};
+
+// Both buffers of every feed, in wire order
+#define MB_IMAGE_BYTES(F,id,t,i,n)      + (n) * 2
+
+BYTE ModbusImageBuf[2][0 MODBUS_IMAGE(MB_IMAGE_BYTES,0)];
+
+BYTE ModbusImageFront[MB_IMAGES];   // buffer the main loop copies from
+BYTE ModbusImageSeq[MB_IMAGES];     // publications, counted by the producer
+BYTE ModbusImageDone[MB_IMAGES];    // ModbusImageSeq when last copied
+
+//stores register i of the feed in its back buffer, for interrupt handlers
+void ModbusImagePut(BYTE feed, BYTE i, int16 val) {
+   BYTE *p;
+
+   p = &ModbusImageBuf[ModbusImageFront[feed] ^ 1][ModbusImageOff[feed] + i * 2];
+   p[0] = make8(val,1);
+   p[1] = make8(val,0);
+}
+
+//makes the back buffer of the feed current, for interrupt handlers
+void ModbusImagePublish(BYTE feed) {
+   ModbusImageFront[feed] ^= 1;
+   ModbusImageSeq[feed]++;
+}
+
+/*********************************************************************
+ * Function:        void ModbusImageTask(void)
+ *
+ * Overview:        Copies the front buffer of every feed published
+ *                  since the last call into its register bank.  If the
+ *                  producer publishes again during the copy, it may
+ *                  already be writing the buffer being copied, so the
+ *                  copy is done again from the new front buffer.
+ *
+ * Note:            Call from the main loop, before requests are
+ *                  served.
+ ********************************************************************/
+void ModbusImageTask(void) {
+   BYTE f, seq;
+   BYTE *bank;
+   int16 n;
+
+   for (f=0;f<MB_IMAGES;f++) {
+      if (ModbusImageSeq[f] == ModbusImageDone[f])
+         continue;
+      if (ModbusFeed[f].table == MB_HOLDING)
+         bank = &hold_regs[ModbusFeed[f].index * 2];
+      else
+         bank = &input_regs[ModbusFeed[f].index * 2];
+      n = ModbusFeed[f].count * 2;
+      do {
+         seq = ModbusImageSeq[f];
+         memcpy(bank, &ModbusImageBuf[ModbusImageFront[f]][ModbusImageOff[f]], n);
+      } while (seq != ModbusImageSeq[f]);
+      ModbusImageDone[f] = seq;
+
+      if (ModbusFeed[f].table == MB_HOLDING)
+         ModbusRegsDirty(hold_dirty, ModbusFeed[f].index, ModbusFeed[f].count);
+      else
+         ModbusRegsDirty(input_dirty, ModbusFeed[f].index, ModbusFeed[f].count);
+   }
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbimage.h - Double buffered register feeds for interrupt producers.
+//
+// The network path copies whole register blocks out of the banks of
+// mbdata.h in one burst.  A value an interrupt handler stores in the middle
+// of that copy would tear: half a register, or one half of a 32 bit value,
+// old and the other new.  Interrupt handlers therefore never write the
+// banks.  Each one owns a feed, a run of registers with two buffers:
+//
+//  - the handler writes its values into the back buffer with
+//    ModbusImagePut(), then makes them current with ModbusImagePublish(),
+//    which only flips the buffers and counts the publication
+//  - ModbusImageTask(), called from the main loop, copies the front buffer
+//    of each feed published since its last call into the bank.  The copy
+//    is repeated if the handler published again meanwhile, so interrupts
+//    stay enabled throughout.
+//
+// Requests are served from the main loop as well, never during that copy,
+// so every reply is one consistent snapshot.  A handler must write all
+// registers of its feed before each ModbusImagePublish(), since the back
+// buffer holds the values of the publication before the last.
+//
+// The feeds are listed in MODBUS_IMAGE, one X(F, id, table, index, count)
+// per feed, at most 8 of them.  F must be passed through unchanged.  table
+// is MB_HOLDING or MB_INPUT, index the storage index of the feed's first
+// register (see MB_INDEX in mbmap.h), and id the name the handler passes
+// to ModbusImagePut().  For example:
+//
+//  #define MODBUS_IMAGE(X,F) \
+//     X(F, MB_FEED_ADC,   MB_INPUT, 0, 8) \
+//     X(F, MB_FEED_COUNT, MB_INPUT, 8, 2)
+//
+// Each feed takes four bytes of RAM per register.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBIMAGE_H
+#define MBIMAGE_H
+
+#include "modbus/modbus.h"
+
+// Feed ids, in list order from 0
+#define MB_IMAGE_ID(F,id,t,i,n)  id,
+enum { MODBUS_IMAGE(MB_IMAGE_ID,0) MB_IMAGE_END };
+
+#define MB_IMAGE_ONE(F,id,t,i,n) + 1
+#define MB_IMAGES                (0 MODBUS_IMAGE(MB_IMAGE_ONE,0))
+
+#if MB_IMAGES > 8
+ #error At most 8 register feeds are supported
+#endif
+
+typedef struct _MODBUS_FEED {
+   BYTE  table;
+   int16 index;
+   BYTE  count;
+} MODBUS_FEED;
+
+void ModbusImagePut(BYTE feed, BYTE i, int16 val);
+void ModbusImagePublish(BYTE feed);
+void ModbusImageTask(void);
+
+#endif
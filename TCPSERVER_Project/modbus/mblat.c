@@ -0,0 +1,100 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mblat.c - Response time histograms, see mblat.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mblat.h"
+
+// ModbusLatFunc[]: the function codes timed, histogram n for entry n
+#define MB_LAT_ENTRY(fc)   fc,
+
+const BYTE ModbusLatFunc[] = {
+   MODBUS_LATENCY(MB_LAT_ENTRY)
+};
+
+int16 ModbusLatHigh;                // timer 3 overflows
+
+// Replies written but not flushed yet
+static MODBUS_LAT_PEND ModbusLatPending[MB_LAT_PENDING];
+static BYTE ModbusLatCount;
+
+#int_timer3
+void ModbusLatTimerIsr(void) {
+   ModbusLatHigh++;
+}
+
+//starts timer 3, call once at startup
+void ModbusLatInit(void) {
+   ModbusLatHigh = 0;
+   ModbusLatCount = 0;
+   setup_timer_3(T3_INTERNAL | T3_DIV_BY_8);
+   enable_interrupts(INT_TIMER3);
+   enable_interrupts(GLOBAL);
+}
+
+//the time in timer 3 counts.  the overflow count is read again, and the
+//timer with it, if it moved meanwhile.
+int32 ModbusLatNow(void) {
+   int16 high, low;
+
+   do {
+      high = ModbusLatHigh;
+      low = get_timer3();
+   } while (high != ModbusLatHigh);
+   return(make32(high, low));
+}
+
+//counts a response time of t in histogram slot
+static void ModbusLatCountTime(BYTE slot, int32 t) {
+   BYTE b;
+   int16 idx;
+
+   for (b=0;t>1 && b<MB_LAT_BUCKETS-1;b++)
+      t >>= 1;
+
+   idx = MODBUS_LATENCY_INDEX + slot * MB_LAT_BUCKETS + b;
+   if (!++input_regs[idx * 2 + 1])
+      input_regs[idx * 2]++;
+   ModbusRegDirty(input_dirty, idx);
+}
+
+/*********************************************************************
+ * Function:        void ModbusLatPend(BYTE func, int32 start)
+ *
+ * Input:           func    - function code of the request answered
+ *                  start   - ModbusLatNow() when it arrived
+ *
+ * Overview:        Holds the request until ModbusLatFlushed() takes
+ *                  the end time.  Once MB_LAT_PENDING requests wait,
+ *                  further ones end now.
+ ********************************************************************/
+void ModbusLatPend(BYTE func, int32 start) {
+   BYTE slot;
+
+   for (slot=0;slot<sizeof(ModbusLatFunc);slot++) {
+      if (ModbusLatFunc[slot] == func)
+         break;
+   }
+   if (slot == sizeof(ModbusLatFunc))
+      return;
+
+   if (ModbusLatCount == MB_LAT_PENDING) {
+      ModbusLatCountTime(slot, ModbusLatNow() - start);
+      return;
+   }
+   ModbusLatPending[ModbusLatCount].slot = slot;
+   ModbusLatPending[ModbusLatCount].start = start;
+   ModbusLatCount++;
+}
+
+//counts the requests pending, their replies were just flushed
+void ModbusLatFlushed(void) {
+   int32 now;
+   BYTE i;
+
+   now = ModbusLatNow();
+   for (i=0;i<ModbusLatCount;i++)
+      ModbusLatCountTime(ModbusLatPending[i].slot, now - ModbusLatPending[i].start);
+   ModbusLatCount = 0;
+}
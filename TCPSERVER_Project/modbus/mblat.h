@@ -0,0 +1,70 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mblat.h - Response time histograms per function code.
+//
+// Each request is timed from the arrival of its first byte until its
+// reply has gone to the NIC with TCPFlush() or UDPFlush().  Pipelined
+// requests answered in one segment all end with the one flush, and a
+// request held in the reassembly buffer counts from the arrival of the
+// oldest byte buffered.  Requests passed on to the gateway are not timed.
+//
+// The time is counted by timer 3 at CLOCK/32 (4us at 8MHz), extended to
+// 32 bits by its overflow interrupt.  A response time of t counts goes
+// into bucket b with 2^b <= t < 2^(b+1), bucket 0 also taking t = 0 and
+// bucket 15 everything longer, and every bucket is one input register
+// counting its responses:
+//
+//    MODBUS_LATENCY_INDEX + 16 * n + b
+//
+// for the n-th function code listed in MODBUS_LATENCY, one X(function)
+// per code.  The counts wrap, so a master takes the difference of two
+// reads to get the histogram of the time in between, and reads p50 or
+// p99 off its running sum.  Without the list nothing is timed.  For
+// example:
+//
+//  #define MODBUS_LATENCY(X)   X(3) X(4) X(6) X(16)
+//
+// takes the last 64 input registers of the bank.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBLAT_H
+#define MBLAT_H
+
+#define MB_LAT_BUCKETS     16
+
+// Replies of one segment timed at its flush, more are timed as served
+#define MB_LAT_PENDING     8
+
+#ifdef MODBUS_LATENCY
+ #if !getenv("TIMER3")
+  #error Response timing needs timer 3
+ #endif
+
+ #define MB_LAT_ONE(fc)    + 1
+ #define MB_LAT_REGS       ((0 MODBUS_LATENCY(MB_LAT_ONE)) * MB_LAT_BUCKETS)
+
+ // Storage index of the first register, by default the end of the bank
+ #ifndef MODBUS_LATENCY_INDEX
+  #define MODBUS_LATENCY_INDEX  (MODBUS_INPUT_REGS - MB_LAT_REGS)
+ #endif
+
+ #if MODBUS_LATENCY_INDEX + MB_LAT_REGS > MODBUS_INPUT_REGS
+  #error The response time histograms do not fit the input register bank
+ #endif
+
+ typedef struct _MODBUS_LAT_PEND {
+    BYTE  slot;                  // histogram of the function code
+    int32 start;
+ } MODBUS_LAT_PEND;
+
+ void  ModbusLatInit(void);
+ int32 ModbusLatNow(void);
+ void  ModbusLatPend(BYTE func, int32 start);
+ void  ModbusLatFlushed(void);
+#else
+ #define ModbusLatPend(func, start)
+ #define ModbusLatFlushed()
+#endif
+
+#endif
@@ -0,0 +1,235 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbmap.c - Register map lookup tables and range checks, see mbmap.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/modbus.h"
+
+// ModbusUnitSlave[]: slave of each unit id, or MB_NO_SLAVE
+#define MB_UNIT_IS(U,sl,u,c,d,h,i)  + ((u) == (U) ? (sl) + 1 : 0)
+#define MB_UNIT_FOUND(U)   (0 MODBUS_UNITS(MB_UNIT_IS,U))
+#define MB_UNIT(U)         (MB_UNIT_FOUND(U) ? MB_UNIT_FOUND(U) - 1 : \
+                            (U) == 0 || (U) == 0xFF ? 0 : MB_NO_SLAVE)
+#define MB_UNIT8(U)        MB_UNIT(U),   MB_UNIT(U+1), MB_UNIT(U+2), \
+                           MB_UNIT(U+3), MB_UNIT(U+4), MB_UNIT(U+5), \
+                           MB_UNIT(U+6), MB_UNIT(U+7)
+#define MB_UNIT64(U)       MB_UNIT8(U),    MB_UNIT8(U+8),  MB_UNIT8(U+16), \
+                           MB_UNIT8(U+24), MB_UNIT8(U+32), MB_UNIT8(U+40), \
+                           MB_UNIT8(U+48), MB_UNIT8(U+56)
+
+const BYTE ModbusUnitSlave[256] = {
+   MB_UNIT64(0), MB_UNIT64(64), MB_UNIT64(128), MB_UNIT64(192)
+};
+
+// ModbusSlaveBase[]: storage index of address 0 of each map table, the
+// points of the same table of all slaves listed before it
+#define MB_POINTS(t,c,d,h,i)  ((t) == MB_COILS ? (c) : (t) == MB_DISCRETE ? (d) : \
+                               (t) == MB_HOLDING ? (h) : (i))
+#define MB_BEFORE(T,sl,u,c,d,h,i) \
+   + ((sl) < (T) / MB_TABLES ? MB_POINTS((T) % MB_TABLES,c,d,h,i) : 0)
+#define MB_BASE(T)         (0 MODBUS_UNITS(MB_BEFORE,T))
+#define MB_BASE_ROW(S)     MB_BASE(MB_SLAVE(S,MB_COILS)),   \
+                           MB_BASE(MB_SLAVE(S,MB_DISCRETE)), \
+                           MB_BASE(MB_SLAVE(S,MB_HOLDING)), \
+                           MB_BASE(MB_SLAVE(S,MB_INPUT))
+
+const int16 ModbusSlaveBase[MB_MAP_TABLES] = {
+   MB_BASE_ROW(0)
+#if MODBUS_SLAVES > 1
+   , MB_BASE_ROW(1)
+#endif
+#if MODBUS_SLAVES > 2
+   , MB_BASE_ROW(2)
+#endif
+#if MODBUS_SLAVES > 3
+   , MB_BASE_ROW(3)
+#endif
+};
+
+// ModbusMap[]: one entry per range, closed by an entry no table matches
+#define MB_RANGE_ENTRY(T,B,t,s,n,ty,a,cb)   {t, s, (s)+(n), ty, a, cb},
+
+const MODBUS_RANGE ModbusMap[] = {
+   MODBUS_MAP(MB_RANGE_ENTRY,0,0)
+   {MB_MAP_TABLES, 0, 0, MB_BIT, MB_RO, MB_NO_CB}
+};
+
+// ModbusMapFirst[][]: number of ranges listed before the first one of table
+// T that ends after the start of block B, which is that range's index
+#define MB_RANGE_BEFORE(T,B,t,s,n,ty,a,cb) \
+   + ((t) < (T) || ((t) == (T) && (s)+(n) <= ((int16)(B) << MB_BLOCK_SHIFT)))
+#define MB_FIRST(T,B)      (0 MODBUS_MAP(MB_RANGE_BEFORE,T,B))
+#define MB_FIRST8(T,B)     MB_FIRST(T,B), MB_FIRST(T,B+1), MB_FIRST(T,B+2), \
+                           MB_FIRST(T,B+3), MB_FIRST(T,B+4), MB_FIRST(T,B+5), \
+                           MB_FIRST(T,B+6), MB_FIRST(T,B+7)
+#define MB_FIRST64(T,B)    MB_FIRST8(T,B), MB_FIRST8(T,B+8), MB_FIRST8(T,B+16), \
+                           MB_FIRST8(T,B+24), MB_FIRST8(T,B+32), MB_FIRST8(T,B+40), \
+                           MB_FIRST8(T,B+48), MB_FIRST8(T,B+56)
+
+#define MB_FIRST_ROW(T)    {MB_FIRST64(T,0), MB_FIRST64(T,64)}
+#define MB_FIRST_ROWS(S)   MB_FIRST_ROW(MB_SLAVE(S,MB_COILS)),    \
+                           MB_FIRST_ROW(MB_SLAVE(S,MB_DISCRETE)), \
+                           MB_FIRST_ROW(MB_SLAVE(S,MB_HOLDING)),  \
+                           MB_FIRST_ROW(MB_SLAVE(S,MB_INPUT))
+
+const BYTE ModbusMapFirst[MB_MAP_TABLES][MB_BLOCKS] = {
+   MB_FIRST_ROWS(0)
+#if MODBUS_SLAVES > 1
+   , MB_FIRST_ROWS(1)
+#endif
+#if MODBUS_SLAVES > 2
+   , MB_FIRST_ROWS(2)
+#endif
+#if MODBUS_SLAVES > 3
+   , MB_FIRST_ROWS(3)
+#endif
+};
+
+// ModbusMapBlocks[][]: bit b&7 of byte b>>3 is set if block b of the table
+// holds at least one mapped address
+#define MB_RANGE_IN_BLOCK(T,B,t,s,n,ty,a,cb) \
+   | ((t) == (T) && (s) < (((int16)(B) + 1) << MB_BLOCK_SHIFT) && \
+      (s)+(n) > ((int16)(B) << MB_BLOCK_SHIFT))
+#define MB_USED(T,B)       (0 MODBUS_MAP(MB_RANGE_IN_BLOCK,T,B))
+#define MB_USED8(T,B)      (MB_USED(T,B)   | MB_USED(T,B+1) << 1 | \
+                            MB_USED(T,B+2) << 2 | MB_USED(T,B+3) << 3 | \
+                            MB_USED(T,B+4) << 4 | MB_USED(T,B+5) << 5 | \
+                            MB_USED(T,B+6) << 6 | MB_USED(T,B+7) << 7)
+#define MB_USED64(T,B)     MB_USED8(T,B),    MB_USED8(T,B+8), \
+                           MB_USED8(T,B+16), MB_USED8(T,B+24), \
+                           MB_USED8(T,B+32), MB_USED8(T,B+40), \
+                           MB_USED8(T,B+48), MB_USED8(T,B+56)
+
+#define MB_USED_ROW(T)     {MB_USED64(T,0), MB_USED64(T,64)}
+#define MB_USED_ROWS(S)    MB_USED_ROW(MB_SLAVE(S,MB_COILS)),    \
+                           MB_USED_ROW(MB_SLAVE(S,MB_DISCRETE)), \
+                           MB_USED_ROW(MB_SLAVE(S,MB_HOLDING)),  \
+                           MB_USED_ROW(MB_SLAVE(S,MB_INPUT))
+
+const BYTE ModbusMapBlocks[MB_MAP_TABLES][MB_BLOCKS / 8] = {
+   MB_USED_ROWS(0)
+#if MODBUS_SLAVES > 1
+   , MB_USED_ROWS(1)
+#endif
+#if MODBUS_SLAVES > 2
+   , MB_USED_ROWS(2)
+#endif
+#if MODBUS_SLAVES > 3
+   , MB_USED_ROWS(3)
+#endif
+};
+
+//FALSE if a block the request touches holds no mapped address at all.  A
+//probe of an unmapped area is refused here on a few bit tests, without
+//looking at the ranges.
+static BOOL ModbusMapBlocksUsed(BYTE table, int16 addr, int16 qty) {
+   int16 b, last;
+
+   b = addr >> MB_BLOCK_SHIFT;
+   last = (addr + qty - 1) >> MB_BLOCK_SHIFT;
+   if (last >= MB_BLOCKS || last < b)
+      return(FALSE);
+   for (;;) {
+      if (!bit_test(ModbusMapBlocks[table][b >> 3], b & 7))
+         return(FALSE);
+      if (b == last)
+         return(TRUE);
+      b++;
+   }
+}
+
+//index in ModbusMap[] of the range holding address addr, or MB_NO_RANGE
+BYTE ModbusMapFind(BYTE table, int16 addr) {
+   BYTE i;
+
+   if ((addr >> MB_BLOCK_SHIFT) >= MB_BLOCKS)
+      return(MB_NO_RANGE);
+
+   i = ModbusMapFirst[table][addr >> MB_BLOCK_SHIFT];
+
+   //skip ranges that end inside the block before addr
+   while (ModbusMap[i].table == table && ModbusMap[i].end <= addr)
+      i++;
+
+   if (ModbusMap[i].table != table || ModbusMap[i].start > addr)
+      return(MB_NO_RANGE);
+   return(i);
+}
+
+/*********************************************************************
+ * Function:        BYTE ModbusMapCheck(BYTE table, int16 addr,
+ *                                      int16 qty, int1 write)
+ *
+ * Input:           table   - map table, MB_SLAVE(slave, table)
+ *                  addr    - first address of the request
+ *                  qty     - number of points or registers, at least 1
+ *                  write   - TRUE if the request writes
+ *
+ * Output:          0 if the request may go ahead, else the exception
+ *                  code to answer with.
+ *
+ * Overview:        The request must be covered by ranges without gaps.
+ *                  A write must not touch read only ranges and must
+ *                  not start or end in the middle of a 32 bit value.
+ ********************************************************************/
+BYTE ModbusMapCheck(BYTE table, int16 addr, int16 qty, int1 write) {
+   BYTE i;
+   int16 end, start;
+
+   if (!ModbusMapBlocksUsed(table, addr, qty))
+      return(ILLEGAL_DATA_ADDRESS);
+   i = ModbusMapFind(table, addr);
+   if (i == MB_NO_RANGE)
+      return(ILLEGAL_DATA_ADDRESS);
+
+   end = addr + qty;
+   for (;;) {
+      if (write) {
+         if (ModbusMap[i].access == MB_RO)
+            return(ILLEGAL_DATA_ADDRESS);
+         if (ModbusMap[i].type >= MB_U32) {
+            start = ModbusMap[i].start;
+            if (addr > start && ((addr - start) & 1))
+               return(ILLEGAL_DATA_ADDRESS);
+            if (end < ModbusMap[i].end && ((end - start) & 1))
+               return(ILLEGAL_DATA_ADDRESS);
+         }
+      }
+      if (end <= ModbusMap[i].end)
+         return(0);
+
+      //the request runs on into the next range, which must follow directly
+      if (ModbusMap[i+1].table != table ||
+          ModbusMap[i+1].start != ModbusMap[i].end)
+         return(ILLEGAL_DATA_ADDRESS);
+      i++;
+   }
+}
+
+#ifdef MODBUS_MAP_CALLBACKS
+//calls the callback of every range the request touches, with the part of
+//the request that falls into that range
+void ModbusMapNotify(BYTE table, int16 addr, int16 qty, int1 write) {
+   BYTE i;
+   int16 end, s, e;
+
+   i = ModbusMapFind(table, addr);
+   if (i == MB_NO_RANGE)
+      return;
+
+   end = addr + qty;
+   while (ModbusMap[i].table == table && ModbusMap[i].start < end) {
+      if (ModbusMap[i].callback != MB_NO_CB) {
+         s = ModbusMap[i].start;
+         if (s < addr)
+            s = addr;
+         e = ModbusMap[i].end;
+         if (e > end)
+            e = end;
+         ModbusMapCallback(ModbusMap[i].callback, s, e - s, write);
+      }
+      i++;
+   }
+}
+#endif
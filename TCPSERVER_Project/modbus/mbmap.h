@@ -0,0 +1,181 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbmap.h - Declarative Modbus register map.
+//
+// The map lists the address ranges the slave serves.  Each range belongs to
+// one table, has a data type, an access flag and an optional callback id.
+// The list is an X-macro, so the compiler turns it into const tables in
+// program memory (see mbmap.c) and no RAM is spent on it:
+//
+//    ModbusMap[]        - the ranges, in the order they are listed
+//    ModbusMapFirst[][] - per table and per block of 16 addresses, the
+//                         first range that may hold an address of the block
+//    ModbusMapBlocks[][] - per table, one bit per block of 16 addresses,
+//                         set if the block holds any mapped address
+//
+// Looking up the range of an address is one table read plus, only when
+// several ranges share a block, a few steps forward in ModbusMap[], so it
+// does not grow with the number of ranges in the map.  Checking a request
+// then takes one more step for each further range the request spans.
+// Requests that touch a block with no mapped address are refused on the
+// block bits alone, before any range is looked at.
+//
+// The tables cover addresses 0 to 2047 of each table.  Ranges and slave
+// sizes beyond that, or slaves that together need more points than the
+// banks of mbdata.h hold, are refused at compile time.
+//
+// To use your own map, define MODBUS_MAP before including the Modbus
+// files.  List one X(T,B, table, start, count, type, access, callback) per
+// range, sorted by table and then by start address.  T and B must be
+// passed through unchanged.  Addresses not covered by any range are
+// illegal, and ranges must lie inside the banks sized in mbdata.h.  For
+// example:
+//
+//  #define MODBUS_MAP(X,T,B) \
+//     X(T,B, MB_COILS,    0,  32, MB_BIT, MB_RW, MB_NO_CB) \
+//     X(T,B, MB_HOLDING,  0,  16, MB_U16, MB_RO, MB_NO_CB) \
+//     X(T,B, MB_HOLDING, 16,  40, MB_F32, MB_RW, 1)        \
+//     X(T,B, MB_INPUT,    0, 100, MB_S16, MB_RO, 2)
+//
+// A range with a callback id other than MB_NO_CB makes the engine call
+// ModbusMapCallback(callback, addr, qty, write).  That happens before a
+// read of the range and after a write to it.  The application provides
+// ModbusMapCallback() and defines MODBUS_MAP_CALLBACKS.
+//
+// One board may act as several slaves, each answering to its own unit id
+// with its own map.  Define MODBUS_SLAVES and list the slaves in
+// MODBUS_UNITS with X(U, slave, unit id, coils, discrete inputs, holding
+// registers, input registers), giving the number of points of each table
+// the slave stores.  The ranges of slave s then use table MB_SLAVE(s,
+// table), and the list stays sorted by slave first:
+//
+//  #define MODBUS_SLAVES 2
+//  #define MODBUS_UNITS(X,U) \
+//     X(U, 0, 0x01, 32, 0,  40, 0)   \
+//     X(U, 1, 0x02,  0, 0, 100, 10)
+//  #define MODBUS_MAP(X,T,B) \
+//     X(T,B, MB_SLAVE(0,MB_COILS),    0, 32, MB_BIT, MB_RW, MB_NO_CB) \
+//     X(T,B, MB_SLAVE(0,MB_HOLDING),  0, 40, MB_U16, MB_RW, MB_NO_CB) \
+//     X(T,B, MB_SLAVE(1,MB_HOLDING),  0,100, MB_U16, MB_RW, MB_NO_CB) \
+//     X(T,B, MB_SLAVE(1,MB_INPUT),    0, 10, MB_U16, MB_RO, MB_NO_CB)
+//
+// The slaves share the banks of mbdata.h, which must be sized for all of
+// them.  Each slave's points follow those of the slaves before it, so
+// address a of slave s is stored at MB_INDEX(s, table, a).  Slave 0 starts
+// at index 0.  A const 256 entry table gives the slave of every unit id,
+// so routing costs one table read.  Unit ids 0 and 0xFF reach slave 0
+// unless listed, other unknown unit ids are answered with exception 0x0B.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBMAP_H
+#define MBMAP_H
+
+// Tables
+#define MB_COILS        0
+#define MB_DISCRETE     1
+#define MB_HOLDING      2
+#define MB_INPUT        3
+#define MB_TABLES       4
+
+// Data types.  32 bit types take two registers, high word first, and may
+// only be written as a whole.
+#define MB_BIT          0
+#define MB_U16          1
+#define MB_S16          2
+#define MB_U32          3
+#define MB_S32          4
+#define MB_F32          5
+
+// Access
+#define MB_RW           0
+#define MB_RO           1
+
+#define MB_NO_CB        0
+#define MB_NO_RANGE     0xFF
+#define MB_NO_SLAVE     0xFF
+
+// Lookup granularity, and blocks per table (covers 2048 addresses)
+#define MB_BLOCK_SHIFT  4
+#define MB_BLOCKS       128
+
+#ifndef MODBUS_UNITS
+ #ifndef MODBUS_UNIT
+  #define MODBUS_UNIT   0xF7
+ #endif
+ #define MODBUS_SLAVES  1
+ #define MODBUS_UNITS(X,U) \
+   X(U, 0, MODBUS_UNIT, MODBUS_COILS, MODBUS_INPUTS, MODBUS_HOLD_REGS, \
+     MODBUS_INPUT_REGS)
+#endif
+
+#if MODBUS_SLAVES > 4
+ #error At most 4 virtual slaves are supported
+#endif
+
+// Map table of table t of slave s
+#define MB_SLAVE(s, t)     ((s) * MB_TABLES + (t))
+#define MB_MAP_TABLES      (MODBUS_SLAVES * MB_TABLES)
+
+// Storage index in the banks of address a in table t of slave s
+#define MB_INDEX(s, t, a)  (ModbusSlaveBase[MB_SLAVE(s, t)] + (a))
+
+#ifndef MODBUS_MAP
+ #define MODBUS_MAP(X,T,B) \
+   X(T,B, MB_COILS,    0, MODBUS_COILS,      MB_BIT, MB_RW, MB_NO_CB) \
+   X(T,B, MB_DISCRETE, 0, MODBUS_INPUTS,     MB_BIT, MB_RO, MB_NO_CB) \
+   X(T,B, MB_HOLDING,  0, MODBUS_HOLD_REGS,  MB_U16, MB_RW, MB_NO_CB) \
+   X(T,B, MB_INPUT,    0, MODBUS_INPUT_REGS, MB_U16, MB_RO, MB_NO_CB)
+#endif
+
+// Addresses the lookup tables cover in each table
+#define MB_MAP_POINTS      (MB_BLOCKS << MB_BLOCK_SHIFT)
+
+#define MB_UNIT_OVER(U,sl,u,c,d,h,i) \
+   || (c) > MB_MAP_POINTS || (d) > MB_MAP_POINTS || \
+      (h) > MB_MAP_POINTS || (i) > MB_MAP_POINTS
+#define MB_RANGE_OVER(T,B,t,s,n,ty,a,cb)  || (s) + (n) > MB_MAP_POINTS
+#define MB_UNIT_POINTS(U,sl,u,c,d,h,i) \
+   + ((U) == MB_COILS ? (c) : (U) == MB_DISCRETE ? (d) : \
+      (U) == MB_HOLDING ? (h) : (i))
+
+#if 0 MODBUS_UNITS(MB_UNIT_OVER,0)
+ #error A slave stores more than 2048 points of a table
+#endif
+#if 0 MODBUS_MAP(MB_RANGE_OVER,0,0)
+ #error A map range runs past address 2047
+#endif
+#if (0 MODBUS_UNITS(MB_UNIT_POINTS,MB_COILS)) > MODBUS_COILS
+ #error The slaves store more coils than MODBUS_COILS
+#endif
+#if (0 MODBUS_UNITS(MB_UNIT_POINTS,MB_DISCRETE)) > MODBUS_INPUTS
+ #error The slaves store more discrete inputs than MODBUS_INPUTS
+#endif
+#if (0 MODBUS_UNITS(MB_UNIT_POINTS,MB_HOLDING)) > MODBUS_HOLD_REGS
+ #error The slaves store more holding registers than MODBUS_HOLD_REGS
+#endif
+#if (0 MODBUS_UNITS(MB_UNIT_POINTS,MB_INPUT)) > MODBUS_INPUT_REGS
+ #error The slaves store more input registers than MODBUS_INPUT_REGS
+#endif
+
+typedef struct _MODBUS_RANGE {
+   BYTE  table;
+   int16 start;
+   int16 end;        // first address after the range
+   BYTE  type;
+   BYTE  access;
+   BYTE  callback;
+} MODBUS_RANGE;
+
+// table arguments are map tables, MB_SLAVE(slave, table)
+BYTE ModbusMapFind(BYTE table, int16 addr);
+BYTE ModbusMapCheck(BYTE table, int16 addr, int16 qty, int1 write);
+
+#ifdef MODBUS_MAP_CALLBACKS
+void ModbusMapCallback(BYTE callback, int16 addr, int16 qty, int1 write);
+void ModbusMapNotify(BYTE table, int16 addr, int16 qty, int1 write);
+#else
+ #define ModbusMapNotify(table, addr, qty, write)
+#endif
+
+#endif
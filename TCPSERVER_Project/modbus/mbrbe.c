@@ -0,0 +1,243 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbrbe.c - Report by exception, see mbrbe.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbrbe.h"
+
+// ModbusRbeRange[]: the watched ranges, closed by an entry with function 0
+#define MB_RBE_ENTRY(u,t,s,n,db) \
+   {u, (t) == MB_HOLDING ? FUNC_READ_HOLDING_REGISTERS : \
+                           FUNC_READ_INPUT_REGISTERS, s, n, db},
+#define MB_RBE_COUNT(u,t,s,n,db)    + (n)
+
+const MODBUS_RBE_RANGE ModbusRbeRange[] = {
+   MODBUS_RBE(MB_RBE_ENTRY)
+   {0, 0, 0, 0, 0}
+};
+
+// Values last reported, the ranges one after the other
+int16 ModbusRbeValue[0 MODBUS_RBE(MB_RBE_COUNT)];
+
+MODBUS_RBE_HOST ModbusRbeHost[MODBUS_RBE_HOSTS];
+
+static UDP_SOCKET ModbusRbeSocket = INVALID_UDP_SOCKET;
+static BYTE ModbusRbeBuf[MODBUS_RBE_SIZE];
+static int16 ModbusRbeLen;          // report staged in ModbusRbeBuf, 0 if none
+static BYTE ModbusRbeNext;          // next host to send the staged report to
+static int16 ModbusRbeSeq;
+static TICKTYPE ModbusRbeTime;
+
+//opens the subscription socket, call once after StackInit()
+void ModbusRBEInit(void) {
+   ModbusRbeSocket = UDPOpen(MODBUS_RBE_PORT, NULL, INVALID_UDP_PORT);
+   ModbusRbeTime = TickGet();
+}
+
+//TRUE if host i holds a subscription that has not lapsed
+static BOOL ModbusRBELive(BYTE i) {
+   if (!ModbusRbeHost[i].port)
+      return(FALSE);
+   if (TickGetDiff(TickGet(), ModbusRbeHost[i].renewed) > MODBUS_RBE_LEASE) {
+      ModbusRbeHost[i].port = 0;
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+//enters, renews or cancels the subscription of the sender of the datagram
+//just received
+static void ModbusRBESubscribe(void) {
+   UDP_SOCKET_INFO *p;
+   BYTE i, free, op;
+
+   p = &UDPSocketInfo[ModbusRbeSocket];
+   if (!UDPGet(&op))
+      return;                       //empty datagram
+
+   free = MODBUS_RBE_HOSTS;
+   for (i=0;i<MODBUS_RBE_HOSTS;i++) {
+      if (!ModbusRBELive(i)) {
+         free = i;
+         continue;
+      }
+      if (ModbusRbeHost[i].port == p->remotePort &&
+          ModbusRbeHost[i].node.IPAddr.Val == p->remoteNode.IPAddr.Val)
+         break;
+   }
+
+   if (!op) {
+      if (i < MODBUS_RBE_HOSTS)
+         ModbusRbeHost[i].port = 0;
+      return;
+   }
+   if (i == MODBUS_RBE_HOSTS) {
+      if (free == MODBUS_RBE_HOSTS)
+         return;                    //table full
+      i = free;
+      memcpy(&ModbusRbeHost[i].node, &p->remoteNode, sizeof(NODE_INFO));
+      ModbusRbeHost[i].port = p->remotePort;
+   }
+   ModbusRbeHost[i].renewed = TickGet();
+}
+
+//stages the watched registers in the dirty blocks of hold and input that
+//moved by more than their deadband, and takes their values as reported.
+//returns FALSE if the report filled up before the scan was done.
+static BOOL ModbusRBEScan(BYTE *hold, BYTE *input) {
+   BYTE i, slave, table, n;
+   BYTE *bank, *dirty;
+   int16 off, base, a, idx, val, diff, grp;
+
+   ModbusRbeLen = 2;
+   off = 0;
+   for (i=0;ModbusRbeRange[i].func;off+=ModbusRbeRange[i++].count) {
+      slave = ModbusUnitSlave[ModbusRbeRange[i].unit];
+      if (slave == MB_NO_SLAVE)
+         continue;
+      if (ModbusRbeRange[i].func == FUNC_READ_HOLDING_REGISTERS) {
+         table = MB_HOLDING;
+         bank = hold_regs;
+         dirty = hold;
+      }
+      else {
+         table = MB_INPUT;
+         bank = input_regs;
+         dirty = input;
+      }
+      base = ModbusSlaveBase[MB_SLAVE(slave, table)] + ModbusRbeRange[i].start;
+
+      n = 0;
+      a = 0;
+      while (a < ModbusRbeRange[i].count) {
+         idx = base + a;
+         //skip to the next block if this one was not written
+         if (!bit_test(dirty[idx >> (MB_DIRTY_SHIFT + 3)],
+                       (idx >> MB_DIRTY_SHIFT) & 7)) {
+            a += (1 << MB_DIRTY_SHIFT) - (idx & ((1 << MB_DIRTY_SHIFT) - 1));
+            continue;
+         }
+
+         val = make16(bank[idx * 2], bank[idx * 2 + 1]);
+         diff = val - ModbusRbeValue[off + a];
+         if (bit_test(diff, 15))
+            diff = -diff;
+         if (diff > ModbusRbeRange[i].deadband) {
+            if (!n) {
+               if (ModbusRbeLen + 3 + 4 > MODBUS_RBE_SIZE)
+                  return(FALSE);
+               grp = ModbusRbeLen;
+               ModbusRbeBuf[grp] = ModbusRbeRange[i].unit;
+               ModbusRbeBuf[grp + 1] = ModbusRbeRange[i].func;
+               ModbusRbeLen += 3;
+            }
+            else if (ModbusRbeLen + 4 > MODBUS_RBE_SIZE) {
+               return(FALSE);
+            }
+            ModbusRbeBuf[ModbusRbeLen++] = make8(ModbusRbeRange[i].start + a, 1);
+            ModbusRbeBuf[ModbusRbeLen++] = make8(ModbusRbeRange[i].start + a, 0);
+            ModbusRbeBuf[ModbusRbeLen++] = make8(val, 1);
+            ModbusRbeBuf[ModbusRbeLen++] = make8(val, 0);
+            ModbusRbeBuf[grp + 2] = ++n;
+            ModbusRbeValue[off + a] = val;
+         }
+         a++;
+      }
+   }
+   return(TRUE);
+}
+
+//takes the dirty bitmaps of both banks and clears them
+static void ModbusRBETake(BYTE *hold, BYTE *input) {
+   BYTE k;
+
+   for (k=0;k<sizeof(hold_dirty);k++) {
+      hold[k] = hold_dirty[k];
+      hold_dirty[k] &= ~hold[k];
+   }
+   for (k=0;k<sizeof(input_dirty);k++) {
+      input[k] = input_dirty[k];
+      input_dirty[k] &= ~input[k];
+   }
+}
+
+//marks the blocks of an unfinished scan dirty again for the next report
+static void ModbusRBEGiveBack(BYTE *hold, BYTE *input) {
+   BYTE k;
+
+   for (k=0;k<sizeof(hold_dirty);k++)
+      hold_dirty[k] |= hold[k];
+   for (k=0;k<sizeof(input_dirty);k++)
+      input_dirty[k] |= input[k];
+}
+
+/*********************************************************************
+ * Function:        void ModbusRBETask(void)
+ *
+ * PreCondition:    ModbusRBEInit() was called.
+ *
+ * Overview:        Handles subscriptions, sends the staged report to
+ *                  the next subscribed host, and stages a new report
+ *                  once every host has the last one and the report
+ *                  period is over.
+ *
+ * Note:            Call from the main loop right after StackTask().
+ ********************************************************************/
+void ModbusRBETask(void) {
+   BYTE hold[sizeof(hold_dirty)], input[sizeof(input_dirty)];
+   UDP_SOCKET_INFO *p;
+   BYTE i;
+
+   if (ModbusRbeSocket == INVALID_UDP_SOCKET)
+      return;
+
+   if (UDPIsGetReady(ModbusRbeSocket)) {
+      ModbusRBESubscribe();
+      UDPDiscard();
+   }
+
+   //the staged report goes out to one host per call
+   if (ModbusRbeLen) {
+      while (ModbusRbeNext < MODBUS_RBE_HOSTS && !ModbusRBELive(ModbusRbeNext))
+         ModbusRbeNext++;
+      if (ModbusRbeNext < MODBUS_RBE_HOSTS) {
+         if (!UDPIsPutReady(ModbusRbeSocket))
+            return;
+         p = &UDPSocketInfo[ModbusRbeSocket];
+         memcpy(&p->remoteNode, &ModbusRbeHost[ModbusRbeNext].node, sizeof(NODE_INFO));
+         p->remotePort = ModbusRbeHost[ModbusRbeNext].port;
+         if (UDPPutReserve(ModbusRbeLen)) {
+            MACPutArray(ModbusRbeBuf, ModbusRbeLen);
+            UDPFlush();
+         }
+         ModbusRbeNext++;
+         return;
+      }
+      ModbusRbeLen = 0;
+   }
+
+   if (TickGetDiff(TickGet(), ModbusRbeTime) < MODBUS_RBE_PERIOD)
+      return;
+   ModbusRbeTime = TickGet();
+
+   //with nobody listening the changes wait in the dirty bitmaps
+   for (i=0;i<MODBUS_RBE_HOSTS;i++) {
+      if (ModbusRBELive(i))
+         break;
+   }
+   if (i == MODBUS_RBE_HOSTS)
+      return;
+
+   ModbusRBETake(hold, input);
+   if (!ModbusRBEScan(hold, input))
+      ModbusRBEGiveBack(hold, input);
+   if (ModbusRbeLen == 2) {
+      ModbusRbeLen = 0;             //nothing changed
+      return;
+   }
+   ModbusRbeBuf[0] = make8(ModbusRbeSeq, 1);
+   ModbusRbeBuf[1] = make8(ModbusRbeSeq, 0);
+   ModbusRbeSeq++;
+   ModbusRbeNext = 0;
+}
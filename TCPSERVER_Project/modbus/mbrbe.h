@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbrbe.h - Report by exception: changed registers pushed over UDP.
+//
+// Instead of polling a large block fast just to notice the few values that
+// changed, a host subscribes to reports.  Every MODBUS_RBE_PERIOD ticks
+// the registers written since the last report are compared with the
+// values last reported, and those that moved by more than their deadband
+// go out in one datagram to each subscribed host.  Masters can then poll
+// slowly and still see every change within one report period.
+//
+// The registers watched are listed in MODBUS_RBE, one X(unit, table,
+// start, count, deadband) per range, table being MB_HOLDING or MB_INPUT of
+// the local slave answering to unit, count at most 255.  A register is
+// reported when it differs from the value last reported by more than
+// deadband, any change for deadband 0.  The deadband holds for every
+// register of its range; a register that needs its own is listed as a
+// range of one.  Without the list there are no reports.  For example:
+//
+//  #define MODBUS_RBE(X) \
+//     X(0xF7, MB_INPUT,    0, 16, 5) \
+//     X(0xF7, MB_HOLDING, 40,  8, 0)
+//
+// Only blocks of 16 registers marked in the register store's dirty
+// bitmaps (see mbdata.h) are looked at, so an unchanged image costs a few
+// bit tests per report.  The watch list takes two bytes of RAM per
+// register listed.
+//
+// A host subscribes by sending a datagram with first byte 1 to
+// MODBUS_RBE_PORT, and cancels with first byte 0.  Reports go to the
+// address and port the subscription came from.  A subscription not
+// renewed within MODBUS_RBE_LEASE ticks lapses.  A report datagram is:
+//
+//    sequence(2), then per range with changes:
+//       unit(1), function(1, 3 or 4), n(1), n x (address(2), value(2))
+//
+// all big endian.  The sequence number counts reports, so a host can tell
+// when it missed one and should poll.  Changes that do not fit into one
+// report go out in the next.  The report is sent to one host per call of
+// ModbusRBETask(), so the main loop never waits for the NIC.
+//
+// The stack must be built with STACK_USE_UDP, with a UDP socket to spare.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBRBE_H
+#define MBRBE_H
+
+#include "modbus/modbus.h"
+
+#ifndef MODBUS_RBE_PORT
+ #define MODBUS_RBE_PORT   (int16)5020
+#endif
+
+// Ticks between reports
+#ifndef MODBUS_RBE_PERIOD
+ #define MODBUS_RBE_PERIOD 1
+#endif
+
+// Subscription lifetime in ticks
+#ifndef MODBUS_RBE_LEASE
+ #define MODBUS_RBE_LEASE  (TICKS_PER_SECOND * 60)
+#endif
+
+#ifndef MODBUS_RBE_HOSTS
+ #define MODBUS_RBE_HOSTS  2
+#endif
+
+// Largest report datagram
+#ifndef MODBUS_RBE_SIZE
+ #define MODBUS_RBE_SIZE   200
+#endif
+
+typedef struct _MODBUS_RBE_RANGE {
+   BYTE  unit;
+   BYTE  func;                   // FC3 or FC4, names the table
+   int16 start;
+   BYTE  count;
+   int16 deadband;               // for each register of the range
+} MODBUS_RBE_RANGE;
+
+typedef struct _MODBUS_RBE_HOST {
+   NODE_INFO node;
+   UDP_PORT  port;               // 0 if the entry is free
+   TICKTYPE  renewed;
+} MODBUS_RBE_HOST;
+
+void ModbusRBEInit(void);
+void ModbusRBETask(void);
+
+#endif
@@ -0,0 +1,198 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbrtu.c - Modbus RTU serial line, see mbrtu.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbrtu.h"
+
+// Timer 1 counts Fosc/32, this many counts make up the 3.5 character gap
+#define MB_RTU_T35_TICKS   ((int16)(MODBUS_RTU_T35_US * \
+                            (int32)(getenv("CLOCK") / 32000) / 1000))
+
+#bit ModbusRTUOERR = getenv("BIT:OERR")
+#bit ModbusRTUCREN = getenv("BIT:CREN")
+
+// The rings are 256 bytes, so the BYTE indexes wrap by themselves
+BYTE ModbusRTURx[256];
+BYTE ModbusRTUTx[256];
+BYTE ModbusRTURxIn, ModbusRTURxOut;
+BYTE ModbusRTUTxIn, ModbusRTUTxOut;
+int1 ModbusRTURxDone;         // a silent gap ended the frame in the ring
+int1 ModbusRTURxLost;         // the frame overran the ring
+
+static int16 ModbusRTUCRC;    // CRC of the frame being queued
+
+// CRC16 tables: new low byte is hi ^ Lo[i], new high byte is Hi[i], with
+// i = lo ^ data byte
+const BYTE ModbusCRCLoTable[256] = {
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+   0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+   0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+   0x00, 0xC1, 0x81, 0x40
+};
+
+const BYTE ModbusCRCHiTable[256] = {
+   0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7,
+   0x05, 0xC5, 0xC4, 0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E,
+   0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09, 0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9,
+   0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD, 0x1D, 0x1C, 0xDC,
+   0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
+   0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32,
+   0x36, 0xF6, 0xF7, 0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D,
+   0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A, 0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38,
+   0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE, 0x2E, 0x2F, 0xEF,
+   0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
+   0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1,
+   0x63, 0xA3, 0xA2, 0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4,
+   0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F, 0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB,
+   0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB, 0x7B, 0x7A, 0xBA,
+   0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
+   0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0,
+   0x50, 0x90, 0x91, 0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97,
+   0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C, 0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E,
+   0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88, 0x48, 0x49, 0x89,
+   0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
+   0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83,
+   0x41, 0x81, 0x80, 0x40
+};
+
+//CRC of one more byte.  The low byte of crc is the one sent first.
+static int16 ModbusCRCUpdate(int16 crc, BYTE b) {
+   BYTE i;
+
+   i = make8(crc,0) ^ b;
+   return(make16(ModbusCRCHiTable[i], make8(crc,1) ^ ModbusCRCLoTable[i]));
+}
+
+#int_rda
+void ModbusRTURxIsr(void) {
+   BYTE b;
+
+   b = getc();
+   if (ModbusRTUOERR) {
+      ModbusRTUCREN = 0;
+      ModbusRTUCREN = 1;
+   }
+
+   //bytes after the end of a frame that was not taken yet are noise
+   if (!ModbusRTURxDone) {
+      if ((BYTE)(ModbusRTURxIn + 1) == ModbusRTURxOut)
+         ModbusRTURxLost = TRUE;
+      else
+         ModbusRTURx[ModbusRTURxIn++] = b;
+   }
+
+   //every byte restarts the 3.5 character timer
+   set_timer1(-MB_RTU_T35_TICKS);
+   clear_interrupt(INT_TIMER1);
+   enable_interrupts(INT_TIMER1);
+}
+
+#int_timer1
+void ModbusRTUT35Isr(void) {
+   disable_interrupts(INT_TIMER1);
+   if (ModbusRTURxIn != ModbusRTURxOut)
+      ModbusRTURxDone = TRUE;
+}
+
+#int_tbe
+void ModbusRTUTxIsr(void) {
+   if (ModbusRTUTxOut == ModbusRTUTxIn)
+      disable_interrupts(INT_TBE);
+   else
+      putc(ModbusRTUTx[ModbusRTUTxOut++]);
+}
+
+void ModbusRTUInit(void) {
+   ModbusRTURxIn = ModbusRTURxOut = 0;
+   ModbusRTUTxIn = ModbusRTUTxOut = 0;
+   ModbusRTURxDone = FALSE;
+   ModbusRTURxLost = FALSE;
+   ModbusRTUCRC = 0xFFFF;
+
+   setup_timer_1(T1_INTERNAL | T1_DIV_BY_8);
+   enable_interrupts(INT_RDA);
+   enable_interrupts(GLOBAL);
+}
+
+//queues one byte of the frame being built, unit id first
+void ModbusRTUPut(BYTE b) {
+   ModbusRTUTx[ModbusRTUTxIn++] = b;
+   ModbusRTUCRC = ModbusCRCUpdate(ModbusRTUCRC, b);
+}
+
+/*********************************************************************
+ * Function:        void ModbusRTUSend(void)
+ *
+ * PreCondition:    The frame was queued with ModbusRTUPut().
+ *
+ * Overview:        Appends the CRC and starts sending the frame.  Any
+ *                  bytes received so far are dropped, so the next
+ *                  frame received is the answer to this one.
+ ********************************************************************/
+void ModbusRTUSend(void) {
+   ModbusRTUTx[ModbusRTUTxIn++] = make8(ModbusRTUCRC,0);
+   ModbusRTUTx[ModbusRTUTxIn++] = make8(ModbusRTUCRC,1);
+   ModbusRTUCRC = 0xFFFF;
+
+   ModbusRTUDiscard();
+   enable_interrupts(INT_TBE);
+}
+
+//TRUE once a whole frame has been received
+BOOL ModbusRTUFrameReady(void) {
+   return(ModbusRTURxDone);
+}
+
+//length of the received frame, CRC included
+int16 ModbusRTUFrameLen(void) {
+   return((BYTE)(ModbusRTURxIn - ModbusRTURxOut));
+}
+
+//byte pos of the received frame
+BYTE ModbusRTUPeek(int16 pos) {
+   return(ModbusRTURx[(BYTE)(ModbusRTURxOut + pos)]);
+}
+
+//TRUE if the received frame is complete and its CRC is right
+BOOL ModbusRTUFrameValid(void) {
+   int16 len, i, crc;
+
+   len = ModbusRTUFrameLen();
+   if (ModbusRTURxLost || len < 4)
+      return(FALSE);
+
+   //the CRC over the whole frame, its own CRC included, comes out 0
+   crc = 0xFFFF;
+   for (i=0;i<len;i++)
+      crc = ModbusCRCUpdate(crc, ModbusRTUPeek(i));
+   return(crc == 0);
+}
+
+//drops the received frame and everything after it
+void ModbusRTUDiscard(void) {
+   disable_interrupts(INT_RDA);
+   ModbusRTURxOut = ModbusRTURxIn;
+   ModbusRTURxDone = FALSE;
+   ModbusRTURxLost = FALSE;
+   enable_interrupts(INT_RDA);
+}
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbrtu.h - Modbus RTU serial line on the hardware UART (PIN_C6/PIN_C7).
+//
+// Both directions are interrupt driven and buffered in 256 byte rings, so
+// the main loop never waits for the serial line.  A frame is queued whole
+// with ModbusRTUPut()/ModbusRTUSend() and shifted out by the transmit
+// interrupt without gaps.  Received bytes go into the receive ring, and
+// timer 1 measures the silent interval after the last byte: once 3.5
+// character times pass without a byte, the frame is complete.
+//
+// The CRC is computed from two const 256 byte tables in program memory,
+// one table read per byte for each CRC half.
+//
+// The UART itself is set up by the #use rs232 in main.h, whose baud rate
+// must match MODBUS_RTU_BAUD.  Timer 1 is used for the frame timing.  The
+// line driver is expected to switch direction by itself, and must not echo
+// the transmitted frame back to the receiver.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBRTU_H
+#define MBRTU_H
+
+#ifndef MODBUS_RTU_BAUD
+ #define MODBUS_RTU_BAUD   9600
+#endif
+
+// Silent interval that ends a frame: 3.5 characters of 11 bits, fixed to
+// 1750us above 19200 baud
+#if MODBUS_RTU_BAUD > 19200
+ #define MODBUS_RTU_T35_US 1750
+#else
+ #define MODBUS_RTU_T35_US (38500000 / MODBUS_RTU_BAUD)
+#endif
+
+// Largest PDU that fits a ring together with unit id and CRC.  Requests
+// and replies of all standard functions fit, FC16 and FC23 included.
+#define MODBUS_RTU_PDU_MAX    252
+
+void  ModbusRTUInit(void);
+
+void  ModbusRTUPut(BYTE b);
+void  ModbusRTUSend(void);
+
+BOOL  ModbusRTUFrameReady(void);
+int16 ModbusRTUFrameLen(void);
+BYTE  ModbusRTUPeek(int16 pos);
+BOOL  ModbusRTUFrameValid(void);
+void  ModbusRTUDiscard(void);
+
+#endif
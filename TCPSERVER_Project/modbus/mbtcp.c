@@ -0,0 +1,323 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbtcp.c - Modbus TCP transport: per connection MBAP framer.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbtcp.h"
+
+MODBUS_CONN ModbusConn[MODBUS_TCP_CONNS];
+
+//requests answered into the socket's current transmit segment
+static int8 ModbusTCPReplies;
+
+//write reply segments sent ahead of waiting reads in a row
+static BYTE ModbusTCPWriteRun;
+//both classes were waiting at the last schedule
+static BOOL ModbusTCPContended;
+//connection that goes first within its class
+static int8 ModbusTCPStart;
+
+#ifdef MODBUS_LATENCY
+//arrival of the segment being framed
+static int32 ModbusTCPNow;
+#endif
+
+//forget any partial request, call when a connection is (re)established
+//on socket s.  replies still owed to the previous connection are no
+//longer delivered.
+void ModbusTCPReset(int8 which, TCP_SOCKET s) {
+   ModbusConn[which].open = TRUE;
+   ModbusConn[which].socket = s;
+   ModbusConn[which].count = 0;
+   ModbusConn[which].epoch++;
+}
+
+//call when the connection's socket is closed, it may be reused by
+//another application.
+void ModbusTCPClose(int8 which) {
+   ModbusConn[which].open = FALSE;
+}
+
+/*********************************************************************
+ * Function:        WORD ModbusTCPAccept(TCP_SOCKET s, WORD len)
+ *
+ * PreCondition:    None
+ *
+ * Input:           s       - socket that received a segment
+ *                  len     - data bytes in the segment
+ *
+ * Output:          Number of the bytes to take now, 0 to len.
+ *
+ * Overview:        Takes no more of a segment than fits into the
+ *                  reassembly buffer of the connection, so that
+ *                  ModbusTCPTask() never has to drop requests it can
+ *                  not answer yet.  Segments of sockets that are not
+ *                  Modbus connections are taken whole.
+ *
+ * Note:            Install it with #define TCP_RX_ACCEPT ModbusTCPAccept
+ *                  before ccstcpip.h is included.  The transmit buffer
+ *                  is shared by all sockets and may be taken before
+ *                  the segment is framed, so replies that could go out
+ *                  straight away are not counted.  A buffer of at least
+ *                  one ADU always takes a single request whole.
+ ********************************************************************/
+WORD ModbusTCPAccept(TCP_SOCKET s, WORD len) {
+   int8 i;
+   int16 room;
+
+   for (i=0;i<MODBUS_TCP_CONNS;i++) {
+      if (ModbusConn[i].open && ModbusConn[i].socket == s) {
+         room = MODBUS_RX_BUFFER_SIZE - ModbusConn[i].count;
+         if (len > room)
+            len = room;
+         break;
+      }
+   }
+   return(len);
+}
+
+//TRUE if the reply to the request ADU at adu, len bytes long, still fits
+//into the socket's transmit segment.  adu must hold the MBAP header and
+//the first 5 bytes of the PDU, or all of it if shorter.
+static BOOL ModbusTCPCanReply(TCP_SOCKET s, BYTE *adu, int16 len) {
+   len = ModbusReplyLen(adu + MODBUS_MBAP_LEN, len - MODBUS_MBAP_LEN);
+   return(TCPIsPutReady(s) && TCPPutAvailable(s) >= MODBUS_MBAP_LEN + len);
+}
+
+//TRUE if the request at the front of the received segment, n bytes of
+//which are unread, is in it whole and its reply fits.  It is then served
+//straight out of the NIC.
+static BOOL ModbusTCPCanServe(TCP_SOCKET s, int16 n) {
+   BYTE adu[MODBUS_MBAP_LEN + 5];
+   int16 len;
+
+   if (n < MODBUS_MBAP_LEN)
+      return(FALSE);
+   TCPPeek(s, 0, adu, sizeof(adu));
+   len = ModbusFrameLen(adu);
+   if (!len || n < len)
+      return(FALSE);
+   return(ModbusTCPCanReply(s, adu, len));
+}
+
+static void ModbusTCPServe(TCP_SOCKET s, int8 which, BYTE *adu, BOOL ram,
+                           int16 len) {
+   memcpy(modbus_rx.mbap, adu, MODBUS_MBAP_LEN);
+   modbus_rx.socket = s;
+   modbus_rx.conn = which;
+   modbus_rx.remain = len - MODBUS_MBAP_LEN;
+   modbus_rx.ram = ram;
+   modbus_rx.udp = FALSE;
+   modbus_rx.ptr = adu + MODBUS_MBAP_LEN;
+   ModbusServe();
+   //a request passed on to the gateway is answered later
+   if (modbus_rx.tx_ok) {
+      ModbusTCPReplies++;
+      ModbusLatPend(modbus_rx.func, ram ? ModbusConn[which].stamp : ModbusTCPNow);
+   }
+}
+
+//serves the complete requests at the front of the reassembly buffer while
+//the socket can take their replies.  returns FALSE on a framing error.
+static BOOL ModbusTCPDrain(TCP_SOCKET s, int8 which) {
+   MODBUS_CONN *c;
+   int16 len;
+
+   c = &ModbusConn[which];
+   while (c->count >= MODBUS_MBAP_LEN) {
+      len = ModbusFrameLen(c->buf);
+      if (!len) {
+         ModbusDiagCount(bus_err);
+         ModbusDiagEvent(MB_EV_RECEIVE | MB_EV_RX_ERROR);
+         return(FALSE);
+      }
+      if (c->count < len || !ModbusTCPCanReply(s, c->buf, len))
+         break;
+      ModbusTCPServe(s, which, c->buf, TRUE, len);
+      c->count -= len;
+      memmove(c->buf, &c->buf[len], c->count);
+   }
+   return(TRUE);
+}
+
+/*********************************************************************
+ * Function:        BOOL ModbusTCPTask(TCP_SOCKET s, int8 which)
+ *
+ * PreCondition:    Socket s is connected, ModbusTCPReset(which, s)
+ *                  was called when the connection was established.
+ *
+ * Input:           s       - connected socket
+ *                  which   - connection index, 0..MODBUS_TCP_CONNS-1
+ *
+ * Output:          TRUE if the stream can not be framed any more and
+ *                  the connection must be dropped, FALSE otherwise.
+ *
+ * Overview:        Frames and serves every request received so far.
+ *                  The received segment is always consumed completely,
+ *                  because the stack drops it on the next StackTask().
+ *
+ * Note:            A master may pipeline several transactions.  They
+ *                  are executed in arrival order and all replies go out
+ *                  together in one segment with a single TCPFlush().
+ *                  Requests that find the segment full, or the socket
+ *                  still waiting for the ACK of the previous segment,
+ *                  wait in the reassembly buffer for the next call.
+ *                  ModbusTCPAccept() keeps the master from sending
+ *                  more than the buffer holds.  Without it a master
+ *                  that overruns the buffer is disconnected.
+ ********************************************************************/
+BOOL ModbusTCPTask(TCP_SOCKET s, int8 which) {
+   MODBUS_CONN *c;
+   int16 n;
+   BOOL lost;
+
+   c = &ModbusConn[which];
+   ModbusTCPReplies = 0;
+  #ifdef MODBUS_LATENCY
+   ModbusTCPNow = ModbusLatNow();
+  #endif
+
+   //requests held over from earlier segments go first
+   lost = !ModbusTCPDrain(s, which);
+
+   if (lost || !TCPIsGetReady(s))
+      n = 0;
+   else
+      n = TCPGetAvailable(s);
+
+   while (n) {
+      if (c->count == 0 && ModbusTCPCanServe(s, n)) {
+         //whole request is in this segment, serve it from the NIC
+         TCPGetArray(s, c->buf, MODBUS_MBAP_LEN);
+         ModbusTCPServe(s, which, c->buf, FALSE, ModbusFrameLen(c->buf));
+         n = TCPGetAvailable(s);
+         continue;
+      }
+
+      if (n > MODBUS_RX_BUFFER_SIZE - c->count)
+         n = MODBUS_RX_BUFFER_SIZE - c->count;
+      if (!n) {
+         ModbusDiagCount(overrun);
+         ModbusDiagEvent(MB_EV_RECEIVE | MB_EV_RX_OVERRUN);
+         lost = TRUE;   //only without ModbusTCPAccept(), see above
+         break;
+      }
+     #ifdef MODBUS_LATENCY
+      if (!c->count)
+         c->stamp = ModbusTCPNow;
+     #endif
+      c->count += TCPGetArray(s, &c->buf[c->count], n);
+      if (!ModbusTCPDrain(s, which)) {
+         lost = TRUE;
+         break;
+      }
+      n = TCPGetAvailable(s);
+   }
+
+   TCPDiscard(s);
+   if (ModbusTCPReplies) {
+      TCPFlush(s);
+      ModbusLatFlushed();
+      //the reads had their turn, or the writes took one more
+      if (c->kind != MB_TCP_WRITE)
+         ModbusTCPWriteRun = 0;
+      else if (ModbusTCPContended)
+         ModbusTCPWriteRun++;
+   }
+   return(lost);
+}
+
+//TRUE if func changes data, see mbtcp.h
+static BOOL ModbusTCPIsWrite(BYTE func) {
+   switch (func) {
+      case FUNC_WRITE_SINGLE_COIL:
+      case FUNC_WRITE_SINGLE_REGISTER:
+      case FUNC_WRITE_MULTIPLE_COILS:
+      case FUNC_WRITE_MULTIPLE_REGISTERS:
+      case FUNC_MASK_WRITE_REGISTER:
+      case FUNC_READ_WRITE_MULTIPLE_REGISTERS:
+         return(TRUE);
+   }
+   return(FALSE);
+}
+
+//class of the next request connection which would serve
+static BYTE ModbusTCPPending(TCP_SOCKET s, int8 which) {
+   MODBUS_CONN *c;
+   BYTE func;
+
+   c = &ModbusConn[which];
+   if (c->count > MODBUS_MBAP_LEN)
+      func = c->buf[MODBUS_MBAP_LEN];
+   else if (c->count || !TCPPeek(s, MODBUS_MBAP_LEN, &func, 1))
+      return((c->count || TCPIsGetReady(s)) ? MB_TCP_READ : MB_TCP_IDLE);
+   return(ModbusTCPIsWrite(func) ? MB_TCP_WRITE : MB_TCP_READ);
+}
+
+/*********************************************************************
+ * Function:        int8 ModbusTCPSchedule(TCP_SOCKET *s, int8 ready,
+ *                                         int8 *order)
+ *
+ * PreCondition:    ModbusTCPReset() was called for every connection
+ *                  in ready when it was established.
+ *
+ * Input:           s       - socket of each connection
+ *                  ready   - bit i set if connection i is connected
+ *                  order   - receives the connections to serve
+ *
+ * Output:          Number of connections stored in order.
+ *
+ * Overview:        Orders the connected connections for this pass of
+ *                  the main loop: writes first, then reads, then the
+ *                  idle ones, except that reads go first once after
+ *                  MODBUS_TCP_WRITE_BURST write segments went ahead of
+ *                  them.
+ *
+ * Note:            Call ModbusTCPTask() for the connections in order
+ *                  before the next StackTask(), so that the received
+ *                  segment is still unread when it is peeked at.
+ ********************************************************************/
+int8 ModbusTCPSchedule(TCP_SOCKET *s, int8 ready, int8 *order) {
+   BYTE rank[3];
+   BYTE r;
+   int8 i, k, n;
+   BOOL writes, reads;
+
+   writes = FALSE;
+   reads = FALSE;
+   for (i=0;i<MODBUS_TCP_CONNS;i++) {
+      if (!bit_test(ready, i))
+         continue;
+      ModbusConn[i].kind = ModbusTCPPending(s[i], i);
+      if (ModbusConn[i].kind == MB_TCP_WRITE)
+         writes = TRUE;
+      else if (ModbusConn[i].kind == MB_TCP_READ)
+         reads = TRUE;
+   }
+   ModbusTCPContended = writes && reads;
+
+   if (ModbusTCPContended && ModbusTCPWriteRun >= MODBUS_TCP_WRITE_BURST) {
+      rank[0] = MB_TCP_READ;
+      rank[1] = MB_TCP_WRITE;
+   }
+   else {
+      rank[0] = MB_TCP_WRITE;
+      rank[1] = MB_TCP_READ;
+   }
+   rank[2] = MB_TCP_IDLE;
+
+   n = 0;
+   for (r=0;r<3;r++) {
+      for (k=0;k<MODBUS_TCP_CONNS;k++) {
+         i = ModbusTCPStart + k;
+         if (i >= MODBUS_TCP_CONNS)
+            i -= MODBUS_TCP_CONNS;
+         if (bit_test(ready, i) && ModbusConn[i].kind == rank[r])
+            order[n++] = i;
+      }
+   }
+   if (++ModbusTCPStart == MODBUS_TCP_CONNS)
+      ModbusTCPStart = 0;
+   return(n);
+}
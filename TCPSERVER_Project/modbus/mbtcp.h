@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbtcp.h - Modbus TCP transport: MBAP framing over a TCP byte stream.
+//
+// TCP does not keep message boundaries.  A request may arrive split over
+// several segments, and one segment may carry several requests.  Each
+// connection therefore runs an incremental framer: the 7 byte MBAP header
+// gives the ADU length, and the ADU is handed to the engine once all of
+// its bytes are in.  A request that arrives whole in one segment is served
+// straight out of the NIC receive buffer.  Only split requests, and
+// requests that cannot be answered yet, are copied to the connection's
+// reassembly buffer.
+//
+// A master may send more than the reassembly buffer can hold while the
+// replies can not go out.  ModbusTCPAccept() is hooked into the stack as
+// TCP_RX_ACCEPT and takes no more of a segment than fits into the buffer.
+// The rest is not ACKed and the master sends it again later, so a master
+// that gets ahead of the replies is held back rather than disconnected.
+//
+// The connections share one transmit buffer, held by a segment of replies
+// until the master acknowledges it.  ModbusTCPSchedule() decides which
+// connection gets it next.  Each connection is classed by the function
+// code of the next request it would serve, found in its reassembly buffer
+// or peeked from the received segment: connections with a write (FC5, 6,
+// 15, 16, 22, 23) at the head are served before those with reads, so
+// a stop command is not queued behind a stream of large FC3 replies on
+// another connection.  Reads still get their share: after
+// MODBUS_TCP_WRITE_BURST reply segments of writes that went ahead of
+// waiting reads, the reads go first once.  Connections of the same class
+// take turns.  Requests of one connection are always served in order.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBTCP_H
+#define MBTCP_H
+
+#include "modbus/modbus.h"
+
+#ifndef MODBUS_TCP_CONNS
+ #define MODBUS_TCP_CONNS      2
+#endif
+
+// Write reply segments sent ahead of waiting reads before the reads go first
+#ifndef MODBUS_TCP_WRITE_BURST
+ #define MODBUS_TCP_WRITE_BURST 4
+#endif
+
+// Classes of connections for the scheduler
+#define MB_TCP_IDLE        0     // nothing to serve
+#define MB_TCP_READ        1     // next request reads, or is not in yet
+#define MB_TCP_WRITE       2     // next request writes
+
+// Reassembly buffer per connection, must hold at least one full ADU
+#ifndef MODBUS_RX_BUFFER_SIZE
+ #define MODBUS_RX_BUFFER_SIZE MODBUS_ADU_MAX
+#endif
+
+typedef struct _MODBUS_CONN {
+   BOOL  open;                         // connected on socket
+   TCP_SOCKET socket;
+   BYTE  epoch;                        // changes with every new connection
+   int16 count;                        // bytes held in buf[]
+   BYTE  kind;                         // class at the last schedule
+  #ifdef MODBUS_LATENCY
+   int32 stamp;                        // arrival of the oldest byte in buf[]
+  #endif
+   BYTE  buf[MODBUS_RX_BUFFER_SIZE];
+} MODBUS_CONN;
+
+void ModbusTCPReset(int8 which, TCP_SOCKET s);
+void ModbusTCPClose(int8 which);
+WORD ModbusTCPAccept(TCP_SOCKET s, WORD len);
+BOOL ModbusTCPTask(TCP_SOCKET s, int8 which);
+int8 ModbusTCPSchedule(TCP_SOCKET *s, int8 ready, int8 *order);
+
+#endif
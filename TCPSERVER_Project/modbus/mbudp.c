@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbudp.c - Modbus UDP transport, see mbudp.h
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/mbudp.h"
+
+static UDP_SOCKET ModbusUDPSocket = INVALID_UDP_SOCKET;
+
+//opens the listening socket, call once after StackInit()
+void ModbusUDPInit(void) {
+   ModbusUDPSocket = UDPOpen(MODBUS_UDP_PORT, NULL, INVALID_UDP_PORT);
+}
+
+/*********************************************************************
+ * Function:        void ModbusUDPTask(void)
+ *
+ * PreCondition:    ModbusUDPInit() was called.
+ *
+ * Overview:        Serves the request in the datagram received by the
+ *                  last StackTask(), if any, and sends its reply.  The
+ *                  datagram is always consumed completely, because the
+ *                  stack drops it on the next StackTask().
+ *
+ * Note:            Call from the main loop right after StackTask().
+ ********************************************************************/
+void ModbusUDPTask(void) {
+   int16 n, len;
+  #ifdef MODBUS_LATENCY
+   int32 start;
+  #endif
+
+   if (ModbusUDPSocket == INVALID_UDP_SOCKET ||
+       !UDPIsGetReady(ModbusUDPSocket))
+      return;
+
+  #ifdef MODBUS_LATENCY
+   start = ModbusLatNow();
+  #endif
+   n = UDPSocketInfo[ModbusUDPSocket].RxCount;
+   if (n >= MODBUS_MBAP_LEN && UDPIsPutReady(ModbusUDPSocket)) {
+      UDPGetArray(modbus_rx.mbap, MODBUS_MBAP_LEN);
+      len = ModbusFrameLen(modbus_rx.mbap);
+      if (len && len == n) {
+         modbus_rx.socket = ModbusUDPSocket;
+         modbus_rx.conn = 0;
+         modbus_rx.remain = len - MODBUS_MBAP_LEN;
+         modbus_rx.ram = FALSE;
+         modbus_rx.udp = TRUE;
+         ModbusServe();
+         if (modbus_rx.tx_ok) {
+            UDPFlush();
+            ModbusLatPend(modbus_rx.func, start);
+            ModbusLatFlushed();
+         }
+      }
+      else {
+         ModbusDiagCount(bus_err);
+         ModbusDiagEvent(MB_EV_RECEIVE | MB_EV_RX_ERROR);
+      }
+   }
+
+   UDPDiscard();
+}
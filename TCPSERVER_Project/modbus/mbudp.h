@@ -0,0 +1,37 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// mbudp.h - Modbus UDP transport: MBAP framing over datagrams.
+//
+// With MODBUS_UDP defined, the engine also answers requests sent as UDP
+// datagrams to port 502.  Each datagram carries exactly one request ADU,
+// with the same MBAP header as over TCP, and gets exactly one datagram
+// back.  A datagram is served straight out of the NIC receive buffer and
+// the reply is written straight into the NIC transmit buffer, so nothing
+// is copied to RAM.
+//
+// There is no per-client state.  The stack aims the listening socket at
+// the sender of each datagram it delivers, and the reply goes back there
+// before the next datagram is taken.  Datagrams whose MBAP length does
+// not match their size are dropped without a reply, as are datagrams that
+// arrive while the NIC is still sending.
+//
+// In gateway mode a request for a unit on the RTU line is only answered
+// from the cache (see mbcache.h).  Relaying it would mean remembering the
+// sender until the serial reply comes, so it is refused with exception
+// 0x0A instead.
+//
+// The stack must be built with STACK_USE_UDP.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MBUDP_H
+#define MBUDP_H
+
+#include "modbus/modbus.h"
+
+#define MODBUS_UDP_PORT    MODBUS_TCP_PORT
+
+void ModbusUDPInit(void);
+void ModbusUDPTask(void);
+
+#endif
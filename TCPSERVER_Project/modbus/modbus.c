@@ -0,0 +1,772 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// modbus.c - Modbus request engine.  Decodes one request PDU, executes it
+// against the register store and writes the response ADU.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "modbus/modbus.h"
+
+MODBUS_REQUEST modbus_rx;
+
+// Map table of the addressed slave, and storage index of one of its
+// addresses
+#define ModbusTable(kind)        (modbus_rx.slave * MB_TABLES + (kind))
+#define ModbusIndex(kind, addr)  (ModbusSlaveBase[ModbusTable(kind)] + (addr))
+
+// Request handlers, numbered densely so the dispatch switch becomes a jump
+// table
+#define MB_H_NONE          0
+#define MB_H_READ_BITS     1
+#define MB_H_READ_REGS     2
+#define MB_H_WRITE_COIL    3
+#define MB_H_WRITE_REG     4
+#define MB_H_WRITE_COILS   5
+#define MB_H_WRITE_REGS    6
+#define MB_H_MASK_WRITE    7
+#define MB_H_READ_WRITE    8
+#define MB_H_DEVICE_ID     9
+#define MB_H_DIAG          10
+
+// Supported function codes and their handlers.  Both const tables below
+// are generated from this list.
+#ifdef MODBUS_DIAG
+ #define MB_DIAG_FUNCS(X,K) \
+   X(K, FUNC_DIAGNOSTICS,                   MB_H_DIAG)        \
+   X(K, FUNC_GET_COMM_EVENT_COUNTER,        MB_H_DIAG)        \
+   X(K, FUNC_GET_COMM_EVENT_LOG,            MB_H_DIAG)
+#else
+ #define MB_DIAG_FUNCS(X,K)
+#endif
+
+#define MODBUS_FUNCS(X,K) \
+   X(K, FUNC_READ_COILS,                    MB_H_READ_BITS)   \
+   X(K, FUNC_READ_DISCRETE_INPUT,           MB_H_READ_BITS)   \
+   X(K, FUNC_READ_HOLDING_REGISTERS,        MB_H_READ_REGS)   \
+   X(K, FUNC_READ_INPUT_REGISTERS,          MB_H_READ_REGS)   \
+   X(K, FUNC_WRITE_SINGLE_COIL,             MB_H_WRITE_COIL)  \
+   X(K, FUNC_WRITE_SINGLE_REGISTER,         MB_H_WRITE_REG)   \
+   X(K, FUNC_WRITE_MULTIPLE_COILS,          MB_H_WRITE_COILS) \
+   X(K, FUNC_WRITE_MULTIPLE_REGISTERS,      MB_H_WRITE_REGS)  \
+   X(K, FUNC_MASK_WRITE_REGISTER,           MB_H_MASK_WRITE)  \
+   X(K, FUNC_READ_WRITE_MULTIPLE_REGISTERS, MB_H_READ_WRITE)  \
+   X(K, FUNC_ENCAPSULATED_INTERFACE,        MB_H_DEVICE_ID)   \
+   MB_DIAG_FUNCS(X,K)
+
+// ModbusFuncBits[]: bit fc&7 of byte fc>>3 is set if function code fc is
+// supported, so an unsupported code costs one bit test
+#define MB_FUNC_BIT(K,fc,h)   | (((fc) >> 3) == (K) ? 1 << ((fc) & 7) : 0)
+#define MB_FUNC_BITS(K)       (0 MODBUS_FUNCS(MB_FUNC_BIT,K))
+#define MB_FUNC_BITS8(K)      MB_FUNC_BITS(K),   MB_FUNC_BITS(K+1), \
+                              MB_FUNC_BITS(K+2), MB_FUNC_BITS(K+3), \
+                              MB_FUNC_BITS(K+4), MB_FUNC_BITS(K+5), \
+                              MB_FUNC_BITS(K+6), MB_FUNC_BITS(K+7)
+
+const BYTE ModbusFuncBits[32] = {
+   MB_FUNC_BITS8(0), MB_FUNC_BITS8(8), MB_FUNC_BITS8(16), MB_FUNC_BITS8(24)
+};
+
+// ModbusFuncHandler[]: handler of each supported function code, indexed by
+// the function code.  Every code in MODBUS_FUNCS must be below its size.
+#define MB_FUNC_IS(K,fc,h)    + ((fc) == (K) ? (h) : 0)
+#define MB_FUNC_HANDLER(K)    (0 MODBUS_FUNCS(MB_FUNC_IS,K))
+#define MB_FUNC_HANDLER8(K)   MB_FUNC_HANDLER(K),   MB_FUNC_HANDLER(K+1), \
+                              MB_FUNC_HANDLER(K+2), MB_FUNC_HANDLER(K+3), \
+                              MB_FUNC_HANDLER(K+4), MB_FUNC_HANDLER(K+5), \
+                              MB_FUNC_HANDLER(K+6), MB_FUNC_HANDLER(K+7)
+
+const BYTE ModbusFuncHandler[0x30] = {
+   MB_FUNC_HANDLER8(0),  MB_FUNC_HANDLER8(8),  MB_FUNC_HANDLER8(16),
+   MB_FUNC_HANDLER8(24), MB_FUNC_HANDLER8(32), MB_FUNC_HANDLER8(40)
+};
+
+// ModbusIdentObj[]: id and length of the device identification objects,
+// ModbusIdentText[]: their values one after the other
+#define MB_IDENT_OBJ(id,s)    {id, sizeof(s) - 1},
+#define MB_IDENT_TEXT(id,s)   s
+#define MB_IDENT_ONE(id,s)    + 1
+#define MB_IDENT_OBJS         (0 MODBUS_IDENT(MB_IDENT_ONE))
+
+// Conformity level: highest category listed, individual access supported
+#define MB_IDENT_CAT(id,s)    | ((id) >= 0x80 ? 4 : (id) >= 0x03 ? 2 : 1)
+#define MB_IDENT_CATS         (0 MODBUS_IDENT(MB_IDENT_CAT))
+#define MB_IDENT_LEVEL        (0x80 | ((MB_IDENT_CATS & 4) ? 3 : \
+                                       (MB_IDENT_CATS & 2) ? 2 : 1))
+
+typedef struct _MODBUS_IDENT_OBJ {
+   BYTE id;
+   BYTE len;
+} MODBUS_IDENT_OBJ;
+
+const MODBUS_IDENT_OBJ ModbusIdentObj[MB_IDENT_OBJS] = {
+   MODBUS_IDENT(MB_IDENT_OBJ)
+};
+
+const char ModbusIdentText[] = MODBUS_IDENT(MB_IDENT_TEXT);
+
+// Last object id of the basic, regular and extended streams
+const BYTE ModbusIdentLast[4] = {0, 0x02, 0x7F, 0xFF};
+
+#ifdef MODBUS_DIAG
+// Send event logged for each exception code
+const BYTE ModbusExcEvent[12] = {
+   0, MB_EV_TX_READ_EXC, MB_EV_TX_READ_EXC, MB_EV_TX_READ_EXC,
+   MB_EV_TX_ABORT_EXC, MB_EV_TX_BUSY_EXC, MB_EV_TX_BUSY_EXC,
+   MB_EV_TX_NAK_EXC, 0, 0, 0, 0
+};
+#endif
+
+//total ADU length announced by the MBAP header at hdr, or 0 if the length
+//field is out of range and the request can not be framed
+int16 ModbusFrameLen(BYTE *hdr) {
+   int16 len;
+
+   len = make16(hdr[4], hdr[5]);
+   if (len < 2 || len > MODBUS_PDU_MAX + 1)
+      return(0);
+   return(len + MODBUS_MBAP_LEN - 1);
+}
+
+//PDU length of the largest reply to the request PDU at pdu, len bytes
+//long.  pdu must hold its first 5 bytes, or all of it if shorter.  A
+//quantity out of range is answered with an exception, 2 bytes.
+int16 ModbusReplyLen(BYTE *pdu, int16 len) {
+   int16 qty;
+
+   qty = 0;
+   if (len >= 5)
+      qty = make16(pdu[3], pdu[4]);
+
+   switch (pdu[0]) {
+      case FUNC_READ_COILS:
+      case FUNC_READ_DISCRETE_INPUT:
+         if (qty > MODBUS_MAX_READ_BITS)
+            return(2);
+         return(2 + (qty + 7) / 8);
+
+      case FUNC_READ_HOLDING_REGISTERS:
+      case FUNC_READ_INPUT_REGISTERS:
+      case FUNC_READ_WRITE_MULTIPLE_REGISTERS:
+         if (qty > MODBUS_MAX_READ_REGS)
+            return(2);
+         return(2 + qty * 2);
+
+      case FUNC_WRITE_SINGLE_COIL:
+      case FUNC_WRITE_SINGLE_REGISTER:
+      case FUNC_WRITE_MULTIPLE_COILS:
+      case FUNC_WRITE_MULTIPLE_REGISTERS:
+      case FUNC_GET_COMM_EVENT_COUNTER:
+         return(5);
+
+      case FUNC_MASK_WRITE_REGISTER:
+         return(7);
+
+      case FUNC_DIAGNOSTICS:
+         return(len > 5 ? len : 5);  //an echo at most
+
+      case FUNC_GET_COMM_EVENT_LOG:
+      case FUNC_ENCAPSULATED_INTERFACE:
+         return(MODBUS_PDU_MAX);
+   }
+   return(2);                       //unsupported, exception 1
+}
+
+BYTE ModbusGet(void) {
+   BYTE b;
+
+   if (!modbus_rx.remain)
+      return(0);
+   modbus_rx.remain--;
+   if (modbus_rx.ram)
+      return(*modbus_rx.ptr++);
+  #ifdef MODBUS_UDP
+   if (modbus_rx.udp) {
+      UDPGet(&b);
+      return(b);
+   }
+  #endif
+   TCPGet(modbus_rx.socket, &b);
+   return(b);
+}
+
+void ModbusGetArray(BYTE *buff, int16 count) {
+   if (count > modbus_rx.remain)
+      count = modbus_rx.remain;
+   modbus_rx.remain -= count;
+   if (modbus_rx.ram) {
+      memcpy(buff, modbus_rx.ptr, count);
+      modbus_rx.ptr += count;
+   }
+  #ifdef MODBUS_UDP
+   else if (modbus_rx.udp) {
+      UDPGetArray(buff, count);
+   }
+  #endif
+   else {
+      TCPGetArray(modbus_rx.socket, buff, count);
+   }
+}
+
+//throw away whatever part of the PDU the handler did not read
+static void ModbusSkip(void) {
+   BYTE b;
+
+   while (modbus_rx.remain)
+      ModbusGetArray(&b, 1);
+}
+
+/*********************************************************************
+ * Function:        BOOL ModbusRspBegin(int16 pdu_len)
+ *
+ * PreCondition:    The transport made sure a full ADU still fits.
+ *
+ * Input:           pdu_len - size of the reply PDU
+ *
+ * Output:          TRUE if the reply was started.
+ *
+ * Overview:        Reserves the whole reply in the socket's transmit
+ *                  segment or datagram and writes the MBAP header
+ *                  there.  The caller then writes exactly pdu_len bytes
+ *                  with ModbusPut()/ModbusPutArray(), which go straight
+ *                  into the NIC transmit buffer.  No reply is staged in
+ *                  RAM.
+ ********************************************************************/
+BOOL ModbusRspBegin(int16 pdu_len) {
+   BYTE hdr[MODBUS_MBAP_LEN];
+
+  #ifdef MODBUS_UDP
+   if (modbus_rx.udp)
+      modbus_rx.tx_ok = UDPPutReserve(MODBUS_MBAP_LEN + pdu_len);
+   else
+  #endif
+   modbus_rx.tx_ok = TCPPutReserve(modbus_rx.socket, MODBUS_MBAP_LEN + pdu_len);
+   if (!modbus_rx.tx_ok)
+      return(FALSE);
+
+   pdu_len++;     //length field also counts the unit id
+   memcpy(hdr, modbus_rx.mbap, 4);
+   hdr[4] = make8(pdu_len,1);
+   hdr[5] = make8(pdu_len,0);
+   hdr[6] = modbus_rx.mbap[6];
+   MACPutArray(hdr, MODBUS_MBAP_LEN);
+   return(TRUE);
+}
+
+void ModbusPut(BYTE b) {
+   if (modbus_rx.tx_ok)
+      MACPut(b);
+}
+
+void ModbusPutArray(BYTE *buff, int16 count) {
+   if (modbus_rx.tx_ok)
+      MACPutArray(buff, count);
+}
+
+void ModbusException(exception error) {
+   BYTE pdu[2];
+
+   modbus_rx.exc = TRUE;
+   ModbusDiagCount(bus_exc);
+   ModbusDiagEvent(MB_EV_SEND | ModbusExcEvent[error]);
+   if (ModbusRspBegin(2)) {
+      pdu[0] = modbus_rx.func | 0x80;
+      pdu[1] = error;
+      MACPutArray(pdu, 2);
+   }
+}
+
+//checks the request against the addressed slave's register map, sends
+//the exception if it is refused
+static BOOL ModbusCheck(BYTE kind, int16 addr, int16 qty, int1 write) {
+   BYTE error;
+
+   error = ModbusMapCheck(ModbusTable(kind), addr, qty, write);
+   if (error) {
+      ModbusException(error);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+//FC3 and FC4: one range check, then the whole block goes out in one burst
+static void ModbusReadRegisters(void) {
+   BYTE req[4];
+   int16 addr, qty;
+   BYTE table;
+
+   if (modbus_rx.remain != 4) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 4);
+   addr = make16(req[0], req[1]);
+   qty = make16(req[2], req[3]);
+
+   if (qty == 0 || qty > MODBUS_MAX_READ_REGS) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+
+   if (modbus_rx.func == FUNC_READ_HOLDING_REGISTERS)
+      table = MB_HOLDING;
+   else
+      table = MB_INPUT;
+   if (!ModbusCheck(table, addr, qty, FALSE))
+      return;
+   ModbusMapNotify(ModbusTable(table), addr, qty, FALSE);
+
+   if (!ModbusRspBegin(2 + qty * 2))
+      return;
+   ModbusPut(modbus_rx.func);
+   ModbusPut(qty * 2);
+   addr = ModbusIndex(table, addr);
+   if (table == MB_HOLDING)
+      ModbusPutArray(&hold_regs[addr * 2], qty * 2);
+   else
+      ModbusPutArray(&input_regs[addr * 2], qty * 2);
+}
+
+//FC6: the value goes from the request straight into the bank
+static void ModbusWriteRegister(void) {
+   BYTE req[2];
+   int16 addr, i;
+
+   if (modbus_rx.remain != 4) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 2);
+   addr = make16(req[0], req[1]);
+   if (!ModbusCheck(MB_HOLDING, addr, 1, TRUE))
+      return;
+   i = ModbusIndex(MB_HOLDING, addr);
+   ModbusGetArray(&hold_regs[i * 2], 2);
+   ModbusRegDirty(hold_dirty, i);
+   ModbusMapNotify(ModbusTable(MB_HOLDING), addr, 1, TRUE);
+
+   if (ModbusRspBegin(5)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPutArray(req, 2);
+      ModbusPutArray(&hold_regs[i * 2], 2);
+   }
+}
+
+//FC16: the whole request is checked first, then the data is copied in one
+//pass from the receive buffer into the bank, with no staging buffer
+static void ModbusWriteRegisters(void) {
+   BYTE req[5];
+   int16 addr, qty;
+
+   if (modbus_rx.remain < 5) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 5);
+   addr = make16(req[0], req[1]);
+   qty = make16(req[2], req[3]);
+
+   if (qty == 0 || qty > MODBUS_MAX_WRITE_REGS ||
+       req[4] != qty * 2 || modbus_rx.remain != req[4]) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   if (!ModbusCheck(MB_HOLDING, addr, qty, TRUE))
+      return;
+   ModbusGetArray(&hold_regs[ModbusIndex(MB_HOLDING, addr) * 2], qty * 2);
+   ModbusRegsDirty(hold_dirty, ModbusIndex(MB_HOLDING, addr), qty);
+   ModbusMapNotify(ModbusTable(MB_HOLDING), addr, qty, TRUE);
+
+   if (ModbusRspBegin(5)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPutArray(req, 4);
+   }
+}
+
+//FC23: write, then read back, in one pass over the holding bank.  Both
+//ranges are checked before anything is written.
+static void ModbusReadWriteRegisters(void) {
+   BYTE req[9];
+   int16 raddr, rqty, waddr, wqty;
+
+   if (modbus_rx.remain < 9) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 9);
+   raddr = make16(req[0], req[1]);
+   rqty = make16(req[2], req[3]);
+   waddr = make16(req[4], req[5]);
+   wqty = make16(req[6], req[7]);
+
+   if (rqty == 0 || rqty > MODBUS_MAX_READ_REGS ||
+       wqty == 0 || wqty > MODBUS_MAX_RW_WRITE_REGS ||
+       req[8] != wqty * 2 || modbus_rx.remain != req[8]) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   if (!ModbusCheck(MB_HOLDING, waddr, wqty, TRUE) ||
+       !ModbusCheck(MB_HOLDING, raddr, rqty, FALSE))
+      return;
+   ModbusGetArray(&hold_regs[ModbusIndex(MB_HOLDING, waddr) * 2], wqty * 2);
+   ModbusRegsDirty(hold_dirty, ModbusIndex(MB_HOLDING, waddr), wqty);
+   ModbusMapNotify(ModbusTable(MB_HOLDING), waddr, wqty, TRUE);
+   ModbusMapNotify(ModbusTable(MB_HOLDING), raddr, rqty, FALSE);
+
+   if (ModbusRspBegin(2 + rqty * 2)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPut(rqty * 2);
+      ModbusPutArray(&hold_regs[ModbusIndex(MB_HOLDING, raddr) * 2], rqty * 2);
+   }
+}
+
+//FC22: result = (current AND and_mask) OR (or_mask AND NOT and_mask).
+//The read-modify-write happens inside one request, so no other master can
+//slip a write in between.
+static void ModbusMaskWriteRegister(void) {
+   BYTE req[6];
+   int16 addr, i, val, and_mask, or_mask;
+
+   if (modbus_rx.remain != 6) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 6);
+   addr = make16(req[0], req[1]);
+   if (!ModbusCheck(MB_HOLDING, addr, 1, TRUE))
+      return;
+   ModbusMapNotify(ModbusTable(MB_HOLDING), addr, 1, FALSE);
+   and_mask = make16(req[2], req[3]);
+   or_mask = make16(req[4], req[5]);
+
+   i = ModbusIndex(MB_HOLDING, addr);
+   val = ModbusHoldingGet(i);
+   val = (val & and_mask) | (or_mask & ~and_mask);
+   ModbusHoldingSet(i, val);
+   ModbusMapNotify(ModbusTable(MB_HOLDING), addr, 1, TRUE);
+
+   if (ModbusRspBegin(7)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPutArray(req, 6);
+   }
+}
+
+//FC5: 0xFF00 turns the coil on, 0x0000 off
+static void ModbusWriteCoil(void) {
+   BYTE req[4];
+   int16 addr;
+
+   if (modbus_rx.remain != 4) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 4);
+   addr = make16(req[0], req[1]);
+   if (req[3] || (req[2] != 0xFF && req[2] != 0)) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   if (!ModbusCheck(MB_COILS, addr, 1, TRUE))
+      return;
+   ModbusCoilSet(ModbusIndex(MB_COILS, addr), req[2] != 0);
+   ModbusMapNotify(ModbusTable(MB_COILS), addr, 1, TRUE);
+
+   if (ModbusRspBegin(5)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPutArray(req, 4);
+   }
+}
+
+//FC1 and FC2: the reply is packed a whole byte at a time from the bit store
+static void ModbusReadBits(void) {
+   BYTE req[4];
+   BYTE out[16];
+   BYTE *bank;
+   int16 addr, qty;
+   BYTE table;
+   int8 n;
+
+   if (modbus_rx.remain != 4) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 4);
+   addr = make16(req[0], req[1]);
+   qty = make16(req[2], req[3]);
+
+   if (qty == 0 || qty > MODBUS_MAX_READ_BITS) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+
+   if (modbus_rx.func == FUNC_READ_COILS) {
+      bank = coils;
+      table = MB_COILS;
+   }
+   else {
+      bank = inputs;
+      table = MB_DISCRETE;
+   }
+   if (!ModbusCheck(table, addr, qty, FALSE))
+      return;
+   ModbusMapNotify(ModbusTable(table), addr, qty, FALSE);
+   addr = ModbusIndex(table, addr);
+
+   n = (qty + 7) >> 3;
+   if (!ModbusRspBegin(2 + n))
+      return;
+   ModbusPut(modbus_rx.func);
+   ModbusPut(n);
+
+   n = 0;
+   while (qty) {
+      out[n] = ModbusBitsGet(bank, addr);
+      if (qty < 8) {
+         out[n] &= 0xFF >> (8 - qty);   //unused high bits go out as 0
+         qty = 0;
+      }
+      else {
+         addr += 8;
+         qty -= 8;
+      }
+      if (++n == sizeof(out) || !qty) {
+         ModbusPutArray(out, n);
+         n = 0;
+      }
+   }
+}
+
+//FC15: the request data is merged into the bit store a whole byte at a time
+static void ModbusWriteCoils(void) {
+   BYTE req[5];
+   BYTE data[16];
+   int16 addr, qty;
+   int8 n, i;
+
+   if (modbus_rx.remain < 5) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 5);
+   addr = make16(req[0], req[1]);
+   qty = make16(req[2], req[3]);
+
+   if (qty == 0 || qty > MODBUS_MAX_WRITE_BITS ||
+       req[4] != (qty + 7) >> 3 || modbus_rx.remain != req[4]) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   if (!ModbusCheck(MB_COILS, addr, qty, TRUE))
+      return;
+   addr = ModbusIndex(MB_COILS, addr);
+
+   while (modbus_rx.remain) {
+      n = sizeof(data);
+      if (n > modbus_rx.remain)
+         n = modbus_rx.remain;
+      ModbusGetArray(data, n);
+      for (i=0;i<n;i++) {
+         if (qty < 8) {
+            ModbusBitsPut(coils, addr, data[i], qty);
+         }
+         else {
+            ModbusBitsPut(coils, addr, data[i], 8);
+            addr += 8;
+            qty -= 8;
+         }
+      }
+   }
+   ModbusMapNotify(ModbusTable(MB_COILS), make16(req[0], req[1]),
+                   make16(req[2], req[3]), TRUE);
+
+   if (ModbusRspBegin(5)) {
+      ModbusPut(modbus_rx.func);
+      ModbusPutArray(req, 4);
+   }
+}
+
+//FC43/14: the objects go from program memory straight into the reply.
+//a stream that does not fit one reply ends with more follows set and the
+//id of the object to ask for next.
+static void ModbusReadDeviceId(void) {
+   BYTE req[3];
+   BYTE i, first, n, last, more, next;
+   int16 off, start, size;
+
+   if (modbus_rx.remain != 3) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+   ModbusGetArray(req, 3);
+   if (req[0] != MODBUS_MEI_DEVICE_ID) {
+      ModbusException(ILLEGAL_FUNCTION);
+      return;
+   }
+   if (req[1] < 1 || req[1] > 4) {
+      ModbusException(ILLEGAL_DATA_VALUE);
+      return;
+   }
+
+   off = 0;
+   for (i=0;i<MB_IDENT_OBJS && ModbusIdentObj[i].id != req[2];i++)
+      off += ModbusIdentObj[i].len;
+   if (req[1] == 4) {
+      if (i == MB_IDENT_OBJS) {
+         ModbusException(ILLEGAL_DATA_ADDRESS);
+         return;
+      }
+      last = req[2];
+   }
+   else {
+      //a stream asked to start at an unknown object starts over
+      last = ModbusIdentLast[req[1]];
+      if (i == MB_IDENT_OBJS || req[2] > last) {
+         i = 0;
+         off = 0;
+      }
+   }
+
+   //objects that fit, counted before anything is written
+   first = i;
+   start = off;
+   size = 7;
+   more = 0;
+   next = 0;
+   for (;i<MB_IDENT_OBJS && ModbusIdentObj[i].id <= last;i++) {
+      if (size + 2 + ModbusIdentObj[i].len > MODBUS_PDU_MAX) {
+         more = 0xFF;
+         next = ModbusIdentObj[i].id;
+         break;
+      }
+      size += 2 + ModbusIdentObj[i].len;
+   }
+   n = i - first;
+
+   if (!ModbusRspBegin(size))
+      return;
+   ModbusPut(modbus_rx.func);
+   ModbusPut(MODBUS_MEI_DEVICE_ID);
+   ModbusPut(req[1]);
+   ModbusPut(MB_IDENT_LEVEL);
+   ModbusPut(more);
+   ModbusPut(next);
+   ModbusPut(n);
+   for (i=first,off=start;n;n--,i++) {
+      ModbusPut(ModbusIdentObj[i].id);
+      ModbusPut(ModbusIdentObj[i].len);
+      for (size=ModbusIdentObj[i].len;size;size--)
+         ModbusPut(ModbusIdentText[off++]);
+   }
+}
+
+/*********************************************************************
+ * Function:        void ModbusServe(void)
+ *
+ * PreCondition:    modbus_rx.mbap holds the MBAP header and the
+ *                  transport has pointed modbus_rx at the PDU.
+ *
+ * Output:          The request is executed and its reply, if any,
+ *                  is written to modbus_rx.socket.  The PDU is
+ *                  always consumed completely.
+ ********************************************************************/
+void ModbusServe(void) {
+   BYTE handler;
+
+   modbus_rx.tx_ok = FALSE;
+   modbus_rx.exc = FALSE;
+
+   //protocol id other than 0 is not Modbus: no reply
+   if (modbus_rx.mbap[2] || modbus_rx.mbap[3]) {
+      ModbusSkip();
+      return;
+   }
+   ModbusDiagCount(bus_msg);
+   ModbusDiagEvent(MB_EV_RECEIVE);
+
+   //unsupported function codes are refused on one bit test, before any
+   //of the request is decoded
+   modbus_rx.func = ModbusGet();
+   if (bit_test(ModbusFuncBits[modbus_rx.func >> 3], modbus_rx.func & 7))
+      handler = ModbusFuncHandler[modbus_rx.func];
+   else
+      handler = MB_H_NONE;
+
+   //the unit id picks the virtual slave, and with it the register map.
+   //other unit ids are passed on to the RTU line in gateway mode.
+   modbus_rx.slave = ModbusUnitSlave[modbus_rx.mbap[6]];
+   if (modbus_rx.slave == MB_NO_SLAVE) {
+     #ifdef MODBUS_GATEWAY
+      if (!ModbusGatewayQueue()) {
+         ModbusDiagCount(srv_busy);
+         ModbusException(GATEWAY_PATH_UNAVAILABLE);
+      }
+     #else
+      ModbusException(GATEWAY_TARGET_NO_RESPONSE);
+     #endif
+      ModbusSkip();
+      return;
+   }
+
+   ModbusDiagCount(srv_msg);
+
+   switch (handler) {
+      case MB_H_READ_BITS:
+         ModbusReadBits();
+         break;
+
+      case MB_H_READ_REGS:
+         ModbusReadRegisters();
+         break;
+
+      case MB_H_WRITE_COIL:
+         ModbusWriteCoil();
+         break;
+
+      case MB_H_WRITE_REG:
+         ModbusWriteRegister();
+         break;
+
+      case MB_H_WRITE_COILS:
+         ModbusWriteCoils();
+         break;
+
+      case MB_H_WRITE_REGS:
+         ModbusWriteRegisters();
+         break;
+
+      case MB_H_MASK_WRITE:
+         ModbusMaskWriteRegister();
+         break;
+
+      case MB_H_READ_WRITE:
+         ModbusReadWriteRegisters();
+         break;
+
+      case MB_H_DEVICE_ID:
+         ModbusReadDeviceId();
+         break;
+
+     #ifdef MODBUS_DIAG
+      case MB_H_DIAG:
+         ModbusDiagServe();
+         break;
+     #endif
+
+      default:
+         ModbusException(ILLEGAL_FUNCTION);
+         break;
+   }
+   ModbusSkip();
+
+  #ifdef MODBUS_DIAG
+   if (!modbus_rx.tx_ok) {
+      ModbusDiagCount(srv_noresp);
+   }
+   else if (!modbus_rx.exc) {
+      ModbusDiagEvent(MB_EV_SEND);
+      //the event counter does not count its own fetches, FC8 it does
+      if (modbus_rx.func != FUNC_GET_COMM_EVENT_COUNTER &&
+          modbus_rx.func != FUNC_GET_COMM_EVENT_LOG)
+         ModbusDiagCount(events);
+   }
+  #endif
+}
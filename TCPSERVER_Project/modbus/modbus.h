@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// modbus.h - Modbus application protocol definitions and the request
+// engine shared by the Modbus transports.
+//
+// A transport (see modbus/mbtcp.c and modbus/mbudp.c) hands the engine one
+// complete request ADU at a time.  The engine reads the PDU through
+// ModbusGet() and ModbusGetArray(), no matter if the bytes still sit in the
+// NIC receive buffer or were reassembled in RAM, and writes the response
+// ADU straight into the NIC transmit buffer at the socket's payload offset.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include "tcpip/stacktsk.h"
+#include "tcpip/tcp.h"
+#ifdef MODBUS_UDP
+ #include "tcpip/udp.h"
+#endif
+#include "modbus/mbdata.h"
+#include "modbus/mbmap.h"
+#include "modbus/mbdiag.h"
+#include "modbus/mblat.h"
+#ifdef MODBUS_GATEWAY
+ #include "modbus/mbgw.h"
+#endif
+
+#define MODBUS_TCP_PORT    (int16)502
+
+// MBAP header: transaction id(2), protocol id(2), length(2), unit id(1)
+#define MODBUS_MBAP_LEN    7
+#define MODBUS_PDU_MAX     253
+#define MODBUS_ADU_MAX     (MODBUS_MBAP_LEN + MODBUS_PDU_MAX)
+
+typedef enum _function {
+   FUNC_READ_COILS=0x01, FUNC_READ_DISCRETE_INPUT=0x02,
+   FUNC_READ_HOLDING_REGISTERS=0x03, FUNC_READ_INPUT_REGISTERS=0x04,
+   FUNC_WRITE_SINGLE_COIL=0x05, FUNC_WRITE_SINGLE_REGISTER=0x06,
+   FUNC_READ_EXCEPTION_STATUS=0x07, FUNC_DIAGNOSTICS=0x08,
+   FUNC_GET_COMM_EVENT_COUNTER=0x0B, FUNC_GET_COMM_EVENT_LOG=0x0C,
+   FUNC_WRITE_MULTIPLE_COILS=0x0F, FUNC_WRITE_MULTIPLE_REGISTERS=0x10,
+   FUNC_REPORT_SLAVE_ID=0x11, FUNC_READ_FILE_RECORD=0x14,
+   FUNC_WRITE_FILE_RECORD=0x15, FUNC_MASK_WRITE_REGISTER=0x16,
+   FUNC_READ_WRITE_MULTIPLE_REGISTERS=0x17, FUNC_READ_FIFO_QUEUE=0x18,
+   FUNC_ENCAPSULATED_INTERFACE=0x2B
+} function;
+
+// FC43 MEI type of Read Device Identification
+#define MODBUS_MEI_DEVICE_ID  0x0E
+
+// Device identification objects served by FC43/14, one X(id, "value") per
+// object in ascending id order: 0x00-0x02 basic (vendor name, product
+// code, revision, all three required), 0x03-0x7F regular, 0x80-0xFF
+// extended.  The values stay in program memory and are copied from there
+// straight into the reply.
+#ifndef MODBUS_IDENT
+ #define MODBUS_IDENT(X) \
+    X(0x00, "Microchip") \
+    X(0x01, "PIC18F4620") \
+    X(0x02, "1.0") \
+    X(0x04, "Modbus TCP server") \
+    X(0x80, __DATE__ " " __TIME__)
+#endif
+
+typedef enum _exception {
+   ILLEGAL_FUNCTION=1, ILLEGAL_DATA_ADDRESS=2, ILLEGAL_DATA_VALUE=3,
+   SLAVE_DEVICE_FAILURE=4, ACKNOWLEDGE=5, SLAVE_DEVICE_BUSY=6,
+   MEMORY_PARITY_ERROR=8, GATEWAY_PATH_UNAVAILABLE=10,
+   GATEWAY_TARGET_NO_RESPONSE=11
+} exception;
+
+// The request being served
+typedef struct _MODBUS_REQUEST {
+   BYTE  mbap[MODBUS_MBAP_LEN];  // header as received, echoed in the reply
+   BYTE  func;
+   BYTE  slave;                  // virtual slave the unit id routes to
+   int16 remain;                 // PDU bytes not read yet
+   int1  ram;                    // PDU is in RAM at ptr, else in the NIC
+   int1  tx_ok;                  // reply space was reserved
+   int1  udp;                    // socket is a UDP socket, else TCP
+   int1  exc;                    // the reply is an exception
+   BYTE  *ptr;
+   TCP_SOCKET socket;            // where the PDU is read from / reply goes
+   BYTE  conn;                   // transport connection index
+} MODBUS_REQUEST;
+
+int16 ModbusFrameLen(BYTE *hdr);
+int16 ModbusReplyLen(BYTE *pdu, int16 len);
+BYTE  ModbusGet(void);
+void  ModbusGetArray(BYTE *buff, int16 count);
+BOOL  ModbusRspBegin(int16 pdu_len);
+void  ModbusPut(BYTE b);
+void  ModbusPutArray(BYTE *buff, int16 count);
+void  ModbusException(exception error);
+void  ModbusServe(void);
+
+#endif
@@ -725,6 +725,62 @@ BOOL TCPPut(TCP_SOCKET s, BYTE byte)
 }
 
 
+/*********************************************************************
+ * Function:        BOOL TCPPutReserve(TCP_SOCKET s, WORD len)
+ *
+ * PreCondition:    TCPIsPutReady() == TRUE
+ *
+ * Input:           s      - socket to use
+ *                  len    - number of bytes the caller will write
+ *
+ * Output:          TRUE if len bytes were reserved in the transmit
+ *                  segment, FALSE if they do not fit.
+ *
+ * Side Effects:    The MAC write pointer is left at the first
+ *                  reserved byte.
+ *
+ * Overview:        Lets an application build its data directly in the
+ *                  MAC transmit buffer.  After a successful call the
+ *                  caller must write exactly len bytes with MACPut() or
+ *                  MACPutArray() before calling any other TCP or UDP
+ *                  function.
+ *
+ * Note:            None
+ ********************************************************************/
+BOOL TCPPutReserve(TCP_SOCKET s, WORD len)
+{
+   SOCKET_INFO* ps;
+
+   ps = &TCB[s];
+
+   if(ps->TxBuffer == INVALID_BUFFER)
+   {
+      if(ps->RemoteWindow == 0)
+         return FALSE;
+
+      ps->TxBuffer = MACGetTxBuffer(FALSE);
+
+      // Check to make sure that we received a TX Buffer
+      if(ps->TxBuffer == INVALID_BUFFER)
+         return FALSE;
+
+      ps->TxCount = 0;
+   }
+
+   if(TCPPutAvailable(s) < len)
+      return FALSE;
+
+   // Position the write pointer behind the data already in this segment
+   IPSetTxBuffer(ps->TxBuffer, sizeof(TCP_HEADER) + ps->TxCount);
+
+   ps->Flags.bIsTxInProgress = TRUE;
+   ps->RemoteWindow -= len;
+   ps->TxCount += len;
+
+   return TRUE;
+}
+
+
 /*********************************************************************
  * Function:        BOOL TCPDiscard(TCP_SOCKET s)
  *
@@ -798,6 +854,12 @@ WORD TCPGetArray(TCP_SOCKET s, BYTE *buff, WORD count)
 
         ps->Flags.bIsTxInProgress = TRUE;
 
+        // Never read past the end of this segment's data
+        if ( count > ps->RxCount )
+            count = ps->RxCount;
+
+        ps->RxCount -= count;
+
         return MACGetArray(buff, count);
     }
     else
@@ -885,6 +947,85 @@ BOOL TCPIsGetReady(TCP_SOCKET s)
     return (TCB[s].Flags.bIsGetReady );
 }
 
+
+
+/*********************************************************************
+ * Function:        int16 TCPGetAvailable(TCP_SOCKET s)
+ *
+ * PreCondition:    TCPInit() is already called.
+ *
+ * Input:           s       - socket
+ *
+ * Output:          Number of data bytes of the received segment not
+ *                  read yet, 0 if socket 's' holds no segment.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Lets an application size its reads, so that it can
+ *                  take apart a segment carrying several messages, or
+ *                  only part of one.
+ *
+ * Note:            The segment must still be read or discarded before
+ *                  the next StackTask().
+ ********************************************************************/
+int16 TCPGetAvailable(TCP_SOCKET s)
+{
+   if ( !TCB[s].Flags.bIsGetReady )
+      return(0);
+
+   return(TCB[s].RxCount);
+}
+
+
+/*********************************************************************
+ * Function:        WORD TCPPeek(TCP_SOCKET s, WORD offset,
+ *                               BYTE *buff, WORD count)
+ *
+ * PreCondition:    TCPInit() is already called.
+ *
+ * Input:           s       - socket
+ *                  offset  - bytes to skip from the next unread one
+ *                  buff    - receives the bytes
+ *                  count   - number of bytes wanted
+ *
+ * Output:          Number of bytes loaded into buff, fewer than count
+ *                  if the segment ends first, 0 if socket 's' holds
+ *                  no segment.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Reads bytes of the received segment without
+ *                  consuming them, so an application can look ahead
+ *                  before it decides how to read the segment.
+ *
+ * Note:            The next read still starts at the next unread byte.
+ ********************************************************************/
+WORD TCPPeek(TCP_SOCKET s, WORD offset, BYTE *buff, WORD count)
+{
+    SOCKET_INFO *ps;
+    WORD pos;
+
+    ps = &TCB[s];
+
+    if ( !ps->Flags.bIsGetReady || offset >= ps->RxCount )
+        return 0;
+
+    if ( count > ps->RxCount - offset )
+        count = ps->RxCount - offset;
+
+    // Bytes of the segment read so far
+    pos = ps->RxLen - ps->RxCount;
+
+    IPSetRxBuffer(sizeof(TCP_HEADER) + pos + offset);
+    count = MACGetArray(buff, count);
+
+    // Put the read pointer back, the first read positions it by itself
+    if ( !ps->Flags.bFirstRead )
+        IPSetRxBuffer(sizeof(TCP_HEADER) + pos);
+
+    return count;
+}
+
 //// internal functions /////
 
 void DebugTCPDisplayState(TCP_STATE st)
@@ -1566,6 +1707,9 @@ static void HandleTCPSeg(TCP_SOCKET s,
    DWORD seq;
    DWORD prevAck, prevSeq;
    SOCKET_INFO *ps;
+#ifdef TCP_RX_ACCEPT
+   WORD take;
+#endif
    BYTE flags;
    //BYTE debugLastState;
    signed int32 temp;
@@ -1671,6 +1815,7 @@ static void HandleTCPSeg(TCP_SOCKET s,
       {
          ps->Flags.bIsGetReady   = TRUE;
          ps->RxCount             = len;
+         ps->RxLen               = len;
          ps->Flags.bFirstRead    = TRUE;
       }
       else   // No application data in this packet
@@ -1745,6 +1890,7 @@ static void HandleTCPSeg(TCP_SOCKET s,
                {
                   ps->Flags.bIsGetReady   = TRUE;
                   ps->RxCount             = len;
+                  ps->RxLen               = len;
                   ps->Flags.bFirstRead    = TRUE;
                }
                else
@@ -1797,12 +1943,38 @@ static void HandleTCPSeg(TCP_SOCKET s,
                // this packet.
                if(len)
                {
+#ifdef TCP_RX_ACCEPT
+                  // Ask the application how much of the data it
+                  // can take.  The rest is not ACKed and the host
+                  // resends it.
+                  if(!h->Flags.bits.flagFIN && !ps->Flags.bIsGetReady)
+                  {
+                     take = TCP_RX_ACCEPT(s, len);
+                     if(take < len)
+                     {
+                        len = take;
+                        ps->SND_ACK = prevAck + (DWORD)take;
+                        ack = ps->SND_ACK;
+                     }
+                  }
+                  // It takes none of it, throw the packet away as
+                  // below.
+                  if(!len)
+                  {
+                     ps->SND_SEQ = prevSeq;
+                     ps->SND_ACK = prevAck;
+
+                     MACDiscardRx();
+                  }
+                  else
+#endif
                   // There is data.  Make it available if we
                   // don't already have data available.
                   if(!ps->Flags.bIsGetReady)
                   {
                      ps->Flags.bIsGetReady   = TRUE;
                      ps->RxCount             = len;
+                     ps->RxLen               = len;
                      ps->Flags.bFirstRead    = TRUE;
 
                      // 4/1/02
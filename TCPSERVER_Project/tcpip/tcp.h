@@ -93,6 +93,7 @@ typedef struct _SOCKET_INFO
     BUFFER TxBuffer;
     WORD TxCount;
     WORD RxCount;
+    WORD RxLen;             // data bytes of the segment held
 	WORD RemoteWindow;
 	
     DWORD SND_SEQ;
@@ -260,6 +261,31 @@ BOOL        TCPIsPutReady(TCP_SOCKET s);
 BOOL        TCPPut(TCP_SOCKET socket, BYTE data);
 
 
+/*********************************************************************
+ * Function:        BOOL TCPPutReserve(TCP_SOCKET s, WORD len)
+ *
+ * PreCondition:    TCPIsPutReady() == TRUE
+ *
+ * Input:           s      - socket to use
+ *                  len    - number of bytes the caller will write
+ *
+ * Output:          TRUE if len bytes were reserved in the transmit
+ *                  segment, FALSE if they do not fit.
+ *
+ * Side Effects:    The MAC write pointer is left at the first
+ *                  reserved byte.
+ *
+ * Overview:        Lets an application build its data directly in the
+ *                  MAC transmit buffer.  After a successful call the
+ *                  caller must write exactly len bytes with MACPut() or
+ *                  MACPutArray() before calling any other TCP or UDP
+ *                  function.
+ *
+ * Note:            None
+ ********************************************************************/
+BOOL        TCPPutReserve(TCP_SOCKET s, WORD len);
+
+
 /*********************************************************************
  * Function:        BOOL TCPFlush(TCP_SOCKET s)
  *
@@ -340,6 +366,83 @@ BOOL        TCPGet(TCP_SOCKET socket, int8 *data);
 WORD        TCPGetArray(TCP_SOCKET s, BYTE *buff, WORD count);
 
 
+/*********************************************************************
+ * Function:        int16 TCPGetAvailable(TCP_SOCKET s)
+ *
+ * PreCondition:    TCPInit() is already called.
+ *
+ * Input:           s       - socket
+ *
+ * Output:          Number of data bytes of the received segment not
+ *                  read yet, 0 if socket 's' holds no segment.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Lets an application size its reads, so that it can
+ *                  take apart a segment carrying several messages, or
+ *                  only part of one.
+ *
+ * Note:            The segment must still be read or discarded before
+ *                  the next StackTask().
+ ********************************************************************/
+int16       TCPGetAvailable(TCP_SOCKET s);
+
+
+/*********************************************************************
+ * Function:        WORD TCPPeek(TCP_SOCKET s, WORD offset,
+ *                               BYTE *buff, WORD count)
+ *
+ * PreCondition:    TCPInit() is already called.
+ *
+ * Input:           s       - socket
+ *                  offset  - bytes to skip from the next unread one
+ *                  buff    - receives the bytes
+ *                  count   - number of bytes wanted
+ *
+ * Output:          Number of bytes loaded into buff, fewer than count
+ *                  if the segment ends first, 0 if socket 's' holds
+ *                  no segment.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Reads bytes of the received segment without
+ *                  consuming them, so an application can look ahead
+ *                  before it decides how to read the segment.
+ *
+ * Note:            The next read still starts at the next unread byte.
+ ********************************************************************/
+WORD        TCPPeek(TCP_SOCKET s, WORD offset, BYTE *buff, WORD count);
+
+
+/*********************************************************************
+ * Function:        WORD TCP_RX_ACCEPT(TCP_SOCKET s, WORD len)
+ *
+ * PreCondition:    TCP_RX_ACCEPT is defined to the name of an
+ *                  application function before ccstcpip.h is
+ *                  included.
+ *
+ * Input:           s       - socket that received the segment
+ *                  len     - data bytes in the segment
+ *
+ * Output:          Number of data bytes the application takes now,
+ *                  0 to len.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Called for every data segment received on an
+ *                  established connection.  Only the bytes taken
+ *                  are made available and ACKed.  The remote node
+ *                  sends the rest again later, so an application
+ *                  that can not keep up holds the remote node back
+ *                  instead of losing data.
+ *
+ * Note:            A segment that carries FIN is always taken whole.
+ ********************************************************************/
+#ifdef TCP_RX_ACCEPT
+WORD        TCP_RX_ACCEPT(TCP_SOCKET s, WORD len);
+#endif
+
+
 /*********************************************************************
  * Function:        BOOL TCPDiscard(TCP_SOCKET s)
  *
@@ -314,6 +314,63 @@ BOOL UDPPut(BYTE v)
 }
 
 
+/*********************************************************************
+ * Function:        BOOL UDPPutReserve(WORD len)
+ *
+ * PreCondition:    UDPIsPutReady() == TRUE with desired UDP socket
+ *
+ * Input:           len     - number of bytes the caller will write
+ *
+ * Output:          TRUE if len bytes were reserved in the datagram,
+ *                  FALSE if they do not fit.
+ *
+ * Side Effects:    The MAC write pointer is left at the first
+ *                  reserved byte.
+ *
+ * Overview:        Lets an application build its data directly in the
+ *                  MAC transmit buffer.  After a successful call the
+ *                  caller must write exactly len bytes with MACPut() or
+ *                  MACPutArray() before calling any other TCP or UDP
+ *                  function.
+ *
+ * Note:            This function loads data into an active UDP socket
+ *                  as determined by previous call to UDPIsPutReady()
+ ********************************************************************/
+BOOL UDPPutReserve(WORD len)
+{
+    UDP_SOCKET_INFO *p;
+
+    p = &UDPSocketInfo[activeUDPSocket];
+
+    if ( p->TxCount == 0 )
+    {
+        p->TxBuffer = MACGetTxBuffer(TRUE);
+
+      // Make sure that we received a TX buffer
+      if(p->TxBuffer == INVALID_BUFFER)
+         return FALSE;
+    }
+
+#if STACK_USE_SLIP
+#define MAX_UDP_DATA  (MAC_TX_BUFFER_SIZE - SIZEOF_MAC_HEADER - sizeof(IP_HEADER) - sizeof(UDP_HEADER))
+#else
+#define MAX_UDP_DATA  (MAC_TX_BUFFER_SIZE - sizeof(IP_HEADER) - sizeof(UDP_HEADER) )
+#endif
+
+    if ( len > MAX_UDP_DATA - p->TxCount )
+        return FALSE;
+#undef MAX_UDP_DATA
+
+    // Position the write pointer behind the data already in this datagram
+    IPSetTxBuffer(p->TxBuffer, sizeof(UDP_HEADER) + p->TxCount);
+
+    p->TxCount += len;
+    p->TxOffset = p->TxCount;
+
+    return TRUE;
+}
+
+
 /*********************************************************************
  * Function:        BOOL UDPFlush(void)
  *
@@ -472,6 +529,56 @@ BOOL UDPGet(BYTE *v)
 }
 
 
+/*********************************************************************
+ * Function:        WORD UDPGetArray(BYTE *buffer, WORD count)
+ *
+ * PreCondition:    UDPInit() is already called     AND
+ *                  UDPIsGetReady(s) == TRUE
+ *
+ * Input:           buffer  - Buffer to hold received data.
+ *                  count   - Buffer length
+ *
+ * Output:          Number of bytes loaded into buffer.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        Reads up to count bytes of the datagram in one
+ *                  MACGetArray() call.
+ *
+ * Note:            This function fetches data from an active UDP
+ *                  socket as set by UDPIsGetReady() call.
+ ********************************************************************/
+WORD UDPGetArray(BYTE *buffer, WORD count)
+{
+    UDP_SOCKET_INFO *p;
+
+    p = &UDPSocketInfo[activeUDPSocket];
+
+    // Never read past the end of this datagram
+    if ( count > p->RxCount )
+        count = p->RxCount;
+    if ( count == 0 )
+        return 0;
+
+    if ( p->Flags.bFirstRead )
+    {
+        p->Flags.bFirstRead = FALSE;
+        UDPSetRxBuffer(0);
+    }
+
+    MACGetArray(buffer, count);
+
+    p->RxCount -= count;
+
+    if ( p->RxCount == 0 )
+    {
+        MACDiscardRx();
+    }
+
+    return count;
+}
+
+
 /*********************************************************************
  * Function:        void UDPDiscard(void)
  *
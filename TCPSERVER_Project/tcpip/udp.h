@@ -206,6 +206,27 @@ BOOL UDPIsPutReady(int8 s) {
 BOOL UDPPut(BYTE v);
 
 
+/*********************************************************************
+ * Function:        BOOL UDPPutReserve(WORD len)
+ *
+ * PreCondition:    UDPIsPutReady() == TRUE with desired UDP socket
+ *
+ * Input:           len     - number of bytes the caller will write
+ *
+ * Output:          TRUE if len bytes were reserved in the datagram,
+ *                  FALSE if they do not fit.
+ *
+ * Side Effects:    The MAC write pointer is left at the first
+ *                  reserved byte.
+ *
+ * Overview:        Lets an application build its data directly in the
+ *                  MAC transmit buffer with MACPut()/MACPutArray().
+ *
+ * Note:            None
+ ********************************************************************/
+BOOL UDPPutReserve(WORD len);
+
+
 /*********************************************************************
  * Function:        BOOL UDPFlush(void)
  *
@@ -275,6 +296,27 @@ BOOL UDPIsGetReady(UDP_SOCKET s);
 BOOL UDPGet(BYTE *v);
 
 
+/*********************************************************************
+ * Function:        WORD UDPGetArray(BYTE *buffer, WORD count)
+ *
+ * PreCondition:    UDPInit() is already called     AND
+ *                  UDPIsGetReady(s) == TRUE
+ *
+ * Input:           buffer  - Buffer to hold received data.
+ *                  count   - Buffer length
+ *
+ * Output:          Number of bytes loaded into buffer.
+ *
+ * Side Effects:    None
+ *
+ * Overview:        None
+ *
+ * Note:            This function fetches data from an active UDP
+ *                  socket as set by UDPIsGetReady() call.
+ ********************************************************************/
+WORD UDPGetArray(BYTE *buffer, WORD count);
+
+
 /*********************************************************************
  * Function:        void UDPDiscard(void)
  *
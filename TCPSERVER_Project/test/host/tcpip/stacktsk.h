@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// stacktsk.h - Host stand-in for the stack types and the CCS built-ins
+// used by the Modbus sources, for the tests in this directory.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef STACKTSK_H
+#define STACKTSK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char   BYTE;
+typedef unsigned short  WORD;
+typedef unsigned int    DWORD;
+typedef unsigned char   BOOL;
+typedef unsigned char   int1;
+typedef unsigned char   int8;
+typedef unsigned short  int16;
+typedef unsigned int    int32;
+typedef signed char     sint8;      // "signed int8" after the Makefile
+typedef signed short    sint16;     // "signed int16" after the Makefile
+
+#define TRUE   1
+#define FALSE  0
+
+#define make8(v,i)         ((BYTE)((DWORD)(v) >> (8 * (i))))
+#define make16(h,l)        ((int16)(((int16)(h) << 8) | (BYTE)(l)))
+#define make32(a,b,c,d)    (((int32)(a) << 24) | ((int32)(b) << 16) | \
+                            ((int32)(c) << 8) | (BYTE)(d))
+#define bit_test(x,b)      (((x) >> (b)) & 1)
+#define bit_set(x,b)       ((x) |= (1 << (b)))
+#define bit_clear(x,b)     ((x) &= ~(1 << (b)))
+
+// Tick.h
+typedef int16 TICKTYPE;
+#define TICKS_PER_SECOND   10
+#define TickGetDiff(a,b)   ((TICKTYPE)((a) - (b)))
+TICKTYPE TickGet(void);
+
+// Interrupts, timer 1 and the UART, implemented by the tests that build
+// mbrtu.c.  getenv() is only asked for the clock, see main.h.
+#define GLOBAL             0
+#define INT_RDA            1
+#define INT_TBE            2
+#define INT_TIMER1         3
+#define T1_INTERNAL        0x85
+#define T1_DIV_BY_8        0x30
+#define getenv(s)          8000000
+void enable_interrupts(int8 i);
+void disable_interrupts(int8 i);
+void clear_interrupt(int8 i);
+void setup_timer_1(int8 mode);
+void set_timer1(int16 v);
+
+#undef getc
+#undef putc
+#define getc()             uart_getc()
+#define putc(b)            uart_putc(b)
+BYTE uart_getc(void);
+void uart_putc(BYTE b);
+
+#endif
@@ -0,0 +1,33 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// tcp.h - Host stand-in for the TCP API used by the Modbus sources.  The
+// tests implement these functions on a fake socket.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef TCP_H
+#define TCP_H
+
+#include "tcpip/stacktsk.h"
+
+typedef BYTE TCP_SOCKET;
+
+#define INVALID_SOCKET     (0xfe)
+
+BOOL  TCPIsGetReady(TCP_SOCKET s);
+int16 TCPGetAvailable(TCP_SOCKET s);
+WORD  TCPGetArray(TCP_SOCKET s, BYTE *buff, WORD count);
+BOOL  TCPGet(TCP_SOCKET s, BYTE *data);
+WORD  TCPPeek(TCP_SOCKET s, WORD offset, BYTE *buff, WORD count);
+BOOL  TCPDiscard(TCP_SOCKET s);
+BOOL  TCPIsPutReady(TCP_SOCKET s);
+int16 TCPPutAvailable(TCP_SOCKET s);
+BOOL  TCPPutReserve(TCP_SOCKET s, WORD len);
+BOOL  TCPFlush(TCP_SOCKET s);
+
+void  MACPut(BYTE b);
+void  MACPutArray(BYTE *b, WORD len);
+BYTE  MACGet(void);
+WORD  MACGetArray(BYTE *b, WORD len);
+
+#endif
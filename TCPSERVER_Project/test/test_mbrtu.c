@@ -0,0 +1,695 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// test_mbrtu.c - Host test of the RTU line (mbrtu.c) and the gateway
+// (mbgw.c).
+//
+// The UART and timer 1 are simulated in timer 1 counts: a byte arrives
+// one character time after the previous one plus the gap before it, and
+// the timer interrupt fires once the count set by the receive interrupt
+// runs over.  The frames sent are checked against a bitwise CRC16, the
+// framing against gaps inside and between frames, and a request for a
+// unit behind the gateway is followed from the TCP socket to the line and
+// its reply back.  Reads from two connections check how the gateway
+// merges them, splits the reply and keeps them behind queued writes.
+// One register range is cached (mbcache.c) to check hits, expiry,
+// invalidation by writes and the widening that refills it.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#define MODBUS_GATEWAY
+
+#define SLAVE     0x11     //unit id behind the gateway
+#define CACHE_AGE 20
+
+#define MODBUS_GW_CACHE(X) \
+   X(SLAVE, MB_HOLDING, 1000, 10, CACHE_AGE)
+
+#include "tcpip/tcp.h"
+
+#include "modbus/mbdata.c"
+#include "modbus/mbmap.c"
+#include "modbus/modbus.c"
+#include "modbus/mbtcp.c"
+#include "modbus/mbrtu.c"
+#include "modbus/mbcache.c"
+#include "modbus/mbgw.c"
+
+#define SOCK      0
+
+// 11 bit characters at 9600 baud, in timer 1 counts of Fosc/32
+#define CHAR_TICKS   (11 * (getenv("CLOCK") / 32) / MODBUS_RTU_BAUD)
+
+//interrupt enables, timer 1 and the UART data register
+static BOOL ie_rda, ie_tbe, ie_t1;
+static long t1;
+static BYTE rcreg;
+
+//bytes sent on the line
+static BYTE wire[512];
+static int  wirelen;
+
+static TICKTYPE ticks;
+
+TICKTYPE TickGet(void) { return(ticks); }
+
+void enable_interrupts(int8 i) {
+   if (i == INT_RDA) ie_rda = TRUE;
+   if (i == INT_TBE) ie_tbe = TRUE;
+   if (i == INT_TIMER1) ie_t1 = TRUE;
+}
+
+void disable_interrupts(int8 i) {
+   if (i == INT_RDA) ie_rda = FALSE;
+   if (i == INT_TBE) ie_tbe = FALSE;
+   if (i == INT_TIMER1) ie_t1 = FALSE;
+}
+
+void clear_interrupt(int8 i) {}
+void setup_timer_1(int8 mode) {}
+void set_timer1(int16 v) { t1 = v; }
+
+BYTE uart_getc(void) { return(rcreg); }
+void uart_putc(BYTE b) { wire[wirelen++] = b; }
+
+//lets n timer 1 counts pass on the line
+static void wait(long n) {
+   t1 += n;
+   if (t1 >= 0x10000) {
+      t1 &= 0xFFFF;
+      if (ie_t1)
+         ModbusRTUT35Isr();
+   }
+}
+
+//one byte arrives gap counts after the end of the previous one
+static void rx(BYTE b, long gap) {
+   wait(gap + CHAR_TICKS);
+   rcreg = b;
+   if (ie_rda)
+      ModbusRTURxIsr();
+}
+
+//shifts out what the transmit ring holds
+static void tx_drain(void) {
+   wirelen = 0;
+   while (ie_tbe)
+      ModbusRTUTxIsr();
+}
+
+//the CRC16 of the Modbus spec, bit by bit
+static int16 ref_crc(BYTE *b, int n) {
+   int16 crc;
+   int i, k;
+
+   crc = 0xFFFF;
+   for (i=0;i<n;i++) {
+      crc ^= b[i];
+      for (k=0;k<8;k++)
+         crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+   }
+   return(crc);
+}
+
+//appends the CRC, low byte first
+static int add_crc(BYTE *b, int n) {
+   int16 crc;
+
+   crc = ref_crc(b, n);
+   b[n++] = crc;
+   b[n++] = crc >> 8;
+   return(n);
+}
+
+//receives frame b with gap counts between its bytes, then the silence
+//that ends it
+static void rx_frame(BYTE *b, int n, long gap) {
+   int i;
+
+   for (i=0;i<n;i++)
+      rx(b[i], i ? gap : 0);
+   wait(MB_RTU_T35_TICKS);
+}
+
+static void fail(const char *what) {
+   printf("%s\n", what);
+   exit(1);
+}
+
+static void test_crc(void) {
+   BYTE vec[8] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD};
+   BYTE f[256];
+   int it, i, n, bit;
+
+   if (add_crc(vec, 6) != 8 || vec[6] != 0xC5 || vec[7] != 0xCD)
+      fail("reference CRC is wrong");
+
+   for (it=0;it<200;it++) {
+      n = 2 + rand() % (MODBUS_RTU_PDU_MAX - 1);
+      for (i=0;i<n;i++) {
+         f[i] = rand();
+         ModbusRTUPut(f[i]);
+      }
+      ModbusRTUSend();
+      tx_drain();
+      n = add_crc(f, n);
+      if (wirelen != n || memcmp(wire, f, n))
+         fail("frame sent with a wrong CRC");
+
+      rx_frame(f, n, 0);
+      if (!ModbusRTUFrameReady() || ModbusRTUFrameLen() != n ||
+          !ModbusRTUFrameValid())
+         fail("good frame refused");
+      ModbusRTUDiscard();
+
+      bit = rand() % (n * 8);
+      f[bit / 8] ^= 1 << (bit % 8);
+      rx_frame(f, n, 0);
+      if (!ModbusRTUFrameReady() || ModbusRTUFrameValid())
+         fail("corrupted frame taken");
+      ModbusRTUDiscard();
+   }
+}
+
+static void test_t35(void) {
+   BYTE f[300];
+   int i, n;
+
+   n = 0;
+   f[n++] = SLAVE;
+   f[n++] = FUNC_READ_HOLDING_REGISTERS;
+   f[n++] = 6;
+   for (i=0;i<6;i++)
+      f[n++] = i;
+   n = add_crc(f, n);
+
+   //gaps of 1.5 characters inside the frame do not end it
+   for (i=0;i<n;i++) {
+      rx(f[i], i ? CHAR_TICKS * 3 / 2 : 0);
+      if (ModbusRTUFrameReady())
+         fail("frame ended by a gap of 1.5 characters");
+   }
+   wait(MB_RTU_T35_TICKS - CHAR_TICKS);
+   if (ModbusRTUFrameReady())
+      fail("frame ended before 3.5 characters of silence");
+   wait(CHAR_TICKS);
+   if (!ModbusRTUFrameReady() || ModbusRTUFrameLen() != n ||
+       !ModbusRTUFrameValid())
+      fail("frame not ended by 3.5 characters of silence");
+
+   //bytes after a frame that was not taken yet are dropped
+   rx_frame(f, n, 0);
+   if (ModbusRTUFrameLen() != n || !ModbusRTUFrameValid())
+      fail("frame not taken yet was changed");
+   ModbusRTUDiscard();
+
+   //a frame longer than the ring is refused
+   for (i=0;i<300;i++)
+      f[i] = i;
+   n = add_crc(f, 298);
+   rx_frame(f, n, 0);
+   if (!ModbusRTUFrameReady() || ModbusRTUFrameValid())
+      fail("frame that overran the ring taken");
+   ModbusRTUDiscard();
+}
+
+//the fake socket: one request per segment, always able to reply
+static BYTE seg[300];
+static int  seglen, segpos;
+static BOOL getready;
+static BYTE tx[1024];
+static int  txlen;
+static int16 putfree = 970;
+//socket of each reply in tx
+static TCP_SOCKET txsock[8];
+static int  txsocks;
+
+BOOL TCPIsGetReady(TCP_SOCKET s) { return(getready); }
+
+int16 TCPGetAvailable(TCP_SOCKET s) {
+   return(getready ? seglen - segpos : 0);
+}
+
+WORD TCPGetArray(TCP_SOCKET s, BYTE *buff, WORD count) {
+   if (count > seglen - segpos)
+      count = seglen - segpos;
+   memcpy(buff, &seg[segpos], count);
+   segpos += count;
+   return(count);
+}
+
+BOOL TCPGet(TCP_SOCKET s, BYTE *data) {
+   if (segpos >= seglen)
+      return(FALSE);
+   *data = seg[segpos++];
+   return(TRUE);
+}
+
+WORD TCPPeek(TCP_SOCKET s, WORD offset, BYTE *buff, WORD count) {
+   if (!getready || segpos + offset >= seglen)
+      return(0);
+   if (count > seglen - segpos - offset)
+      count = seglen - segpos - offset;
+   memcpy(buff, &seg[segpos + offset], count);
+   return(count);
+}
+
+BOOL TCPDiscard(TCP_SOCKET s) {
+   getready = FALSE;
+   return(TRUE);
+}
+
+BOOL TCPIsPutReady(TCP_SOCKET s) { return(TRUE); }
+int16 TCPPutAvailable(TCP_SOCKET s) { return(putfree); }
+BOOL TCPPutReserve(TCP_SOCKET s, WORD len) {
+   txsock[txsocks++] = s;
+   return(TRUE);
+}
+BOOL TCPFlush(TCP_SOCKET s) { return(TRUE); }
+
+void MACPut(BYTE b) { tx[txlen++] = b; }
+
+void MACPutArray(BYTE *b, WORD len) {
+   memcpy(&tx[txlen], b, len);
+   txlen += len;
+}
+
+//the master on connection which, and socket which, sends SLAVE the PDU
+//of n bytes
+static void send_pdu(int8 which, BYTE tid, BYTE *pdu, int n) {
+   seg[0] = 0;
+   seg[1] = tid;
+   seg[2] = 0;
+   seg[3] = 0;
+   seg[4] = 0;
+   seg[5] = n + 1;
+   seg[6] = SLAVE;
+   memcpy(&seg[MODBUS_MBAP_LEN], pdu, n);
+   seglen = MODBUS_MBAP_LEN + n;
+   segpos = 0;
+   getready = TRUE;
+   txlen = 0;
+   txsocks = 0;
+   if (ModbusTCPTask(which, which))
+      fail("connection dropped");
+}
+
+//as send_pdu(), for a request the gateway must queue
+static void master(int8 which, BYTE tid, BYTE *pdu, int n) {
+   send_pdu(which, tid, pdu, n);
+   if (txlen)
+      fail("request for the gateway not queued");
+}
+
+//the master on connection which asks for qty registers at addr
+static void ask(int8 which, BYTE tid, int16 addr, BYTE qty) {
+   BYTE pdu[5] = {FUNC_READ_HOLDING_REGISTERS};
+
+   pdu[1] = addr >> 8;
+   pdu[2] = addr;
+   pdu[3] = 0;
+   pdu[4] = qty;
+   send_pdu(which, tid, pdu, sizeof(pdu));
+}
+
+//as ask(), for a read the gateway must queue
+static void request_on(int8 which, BYTE tid, int16 addr, BYTE qty) {
+   ask(which, tid, addr, qty);
+   if (txlen)
+      fail("request for the gateway not queued");
+}
+
+static void request(BYTE tid, int16 addr, BYTE qty) {
+   request_on(SOCK, tid, addr, qty);
+}
+
+//runs the gateway until it has nothing more to do on its own
+static void gateway(void) {
+   int i;
+
+   for (i=0;i<4;i++)
+      ModbusGatewayTask();
+}
+
+//the largest PDU, FC16 with 123 registers, fits the FIFO and the line
+static void test_gateway_max(void) {
+   BYTE f[16], q[MODBUS_RTU_PDU_MAX + 3];
+   int i, n;
+
+   n = 0;
+   seg[n++] = 0;
+   seg[n++] = 3;
+   seg[n++] = 0;
+   seg[n++] = 0;
+   seg[n++] = 0;
+   seg[n++] = 1 + MODBUS_RTU_PDU_MAX;
+   seg[n++] = SLAVE;
+   seg[n++] = FUNC_WRITE_MULTIPLE_REGISTERS;
+   seg[n++] = 0;
+   seg[n++] = 40;
+   seg[n++] = 0;
+   seg[n++] = 123;
+   seg[n++] = 246;
+   for (i=0;i<246;i++)
+      seg[n++] = i;
+   seglen = n;
+   segpos = 0;
+   getready = TRUE;
+   txlen = 0;
+   if (ModbusTCPTask(SOCK, 0) || txlen)
+      fail("largest request for the gateway not queued");
+   ModbusGatewayTask();
+   tx_drain();
+   memcpy(q, &seg[MODBUS_MBAP_LEN - 1], 1 + MODBUS_RTU_PDU_MAX);
+   n = add_crc(q, 1 + MODBUS_RTU_PDU_MAX);
+   if (wirelen != n || memcmp(wire, q, n))
+      fail("gateway sent a wrong RTU frame for the largest request");
+
+   n = 0;
+   f[n++] = SLAVE;
+   f[n++] = FUNC_WRITE_MULTIPLE_REGISTERS;
+   f[n++] = 0;
+   f[n++] = 40;
+   f[n++] = 0;
+   f[n++] = 123;
+   n = add_crc(f, n);
+   rx_frame(f, n, 0);
+   gateway();
+   if (txlen != MODBUS_MBAP_LEN + 5 || tx[1] != 3 ||
+       memcmp(&tx[MODBUS_MBAP_LEN], &f[1], 5))
+      fail("reply to the largest request not relayed");
+}
+
+//register r of SLAVE holds REG(r)
+#define REG(r)    ((int16)((r) * 7 + 0x1234))
+
+//the next frame the gateway sends must read qty registers at addr
+static void expect_read(int16 addr, BYTE qty, const char *what) {
+   BYTE q[8];
+   int n;
+
+   ModbusGatewayTask();
+   tx_drain();
+   n = 0;
+   q[n++] = SLAVE;
+   q[n++] = FUNC_READ_HOLDING_REGISTERS;
+   q[n++] = addr >> 8;
+   q[n++] = addr;
+   q[n++] = 0;
+   q[n++] = qty;
+   n = add_crc(q, n);
+   if (wirelen != n || memcmp(wire, q, n))
+      fail(what);
+}
+
+//SLAVE answers a read of qty registers at addr
+static void slave_read(int16 addr, BYTE qty) {
+   BYTE f[260];
+   int i, n;
+
+   n = 0;
+   f[n++] = SLAVE;
+   f[n++] = FUNC_READ_HOLDING_REGISTERS;
+   f[n++] = qty * 2;
+   for (i=0;i<qty;i++) {
+      f[n++] = REG(addr + i) >> 8;
+      f[n++] = REG(addr + i);
+   }
+   n = add_crc(f, n);
+   rx_frame(f, n, 0);
+   txlen = 0;
+   txsocks = 0;
+   gateway();
+}
+
+//TRUE if the master on connection which got qty registers at addr as
+//the reply to transaction tid
+static BOOL answered(int8 which, BYTE tid, int16 addr, BYTE qty) {
+   BYTE *r;
+   int i, k, pos;
+
+   for (k=0,pos=0;pos<txlen;k++,pos+=6 + make16(tx[pos+4], tx[pos+5])) {
+      r = &tx[pos];
+      if (txsock[k] != which || r[1] != tid)
+         continue;
+      if (make16(r[4], r[5]) != 3 + qty * 2 || r[6] != SLAVE ||
+          r[7] != FUNC_READ_HOLDING_REGISTERS || r[8] != qty * 2)
+         return(FALSE);
+      for (i=0;i<qty;i++) {
+         if (make16(r[9 + i*2], r[10 + i*2]) != REG(addr + i))
+            return(FALSE);
+      }
+      return(TRUE);
+   }
+   return(FALSE);
+}
+
+//reads of two masters share RTU transactions where their ranges allow
+static void test_coalesce(void) {
+   BYTE pdu[5];
+
+   ModbusTCPReset(0, 0);
+   ModbusTCPReset(1, 1);
+
+   //overlapping ranges go out as one read, each master gets its part
+   request_on(0, 10, 100, 4);
+   request_on(1, 11, 102, 4);
+   expect_read(100, 6, "overlapping reads not merged");
+   slave_read(100, 6);
+   if (txsocks != 2 || !answered(0, 10, 100, 4) || !answered(1, 11, 102, 4))
+      fail("merged read not split between the masters");
+
+   //so do adjoining ones
+   request_on(0, 12, 202, 3);
+   request_on(1, 13, 200, 2);
+   expect_read(200, 5, "adjoining reads not merged");
+   slave_read(200, 5);
+   if (txsocks != 2 || !answered(0, 12, 202, 3) || !answered(1, 13, 200, 2))
+      fail("adjoining read not split between the masters");
+
+   //a gap keeps them apart
+   request_on(0, 14, 300, 2);
+   request_on(1, 15, 303, 2);
+   expect_read(300, 2, "disjoint reads merged");
+   slave_read(300, 2);
+   if (txsocks != 1 || !answered(0, 14, 300, 2))
+      fail("first of two disjoint reads not answered");
+   expect_read(303, 2, "second of two disjoint reads not sent");
+   slave_read(303, 2);
+   if (txsocks != 1 || !answered(1, 15, 303, 2))
+      fail("second of two disjoint reads not answered");
+
+   //a read covered by the one on the line waits for its reply
+   request_on(0, 16, 400, 10);
+   expect_read(400, 10, "read not sent");
+   request_on(1, 17, 403, 3);
+   if (ModbusGwIn != ModbusGwOut)
+      fail("read covered by the one in flight queued");
+   slave_read(400, 10);
+   if (txsocks != 2 || !answered(0, 16, 400, 10) || !answered(1, 17, 403, 3))
+      fail("read in flight not shared");
+   ModbusGatewayTask();
+   tx_drain();
+   if (wirelen)
+      fail("joined read sent again");
+
+   //reads stay behind a write queued before them, both when merging
+   //and when joining the read in flight
+   request_on(0, 18, 500, 2);
+   pdu[0] = FUNC_WRITE_SINGLE_REGISTER;
+   pdu[1] = 500 >> 8;
+   pdu[2] = 501 & 0xFF;
+   pdu[3] = 0x55;
+   pdu[4] = 0xAA;
+   master(0, 19, pdu, 5);
+   request_on(1, 20, 500, 2);
+   expect_read(500, 2, "read merged past a queued write");
+   request_on(1, 21, 500, 1);
+   if (ModbusGwIn == ModbusGwOut)
+      fail("read joined the one in flight past a queued write");
+   slave_read(500, 2);
+   if (txsocks != 1 || !answered(0, 18, 500, 2))
+      fail("read before the write not answered alone");
+
+   ModbusGatewayTask();
+   tx_drain();
+   if (wirelen != 8 || wire[1] != FUNC_WRITE_SINGLE_REGISTER ||
+       wire[3] != (501 & 0xFF))
+      fail("queued write not sent next");
+   rx_frame(wire, wirelen, 0);
+   txlen = 0;
+   txsocks = 0;
+   gateway();
+   if (txlen != MODBUS_MBAP_LEN + 5 || tx[1] != 19)
+      fail("write not answered");
+
+   expect_read(500, 2, "reads after the write not merged");
+   slave_read(500, 2);
+   if (txsocks != 2 || !answered(1, 20, 500, 2) || !answered(1, 21, 500, 1))
+      fail("reads after the write not answered");
+}
+
+//the slave answers the write the gateway just sent with its echo
+static void slave_echo(BYTE tid) {
+   BYTE f[8];
+
+   ModbusGatewayTask();
+   tx_drain();
+   if (wirelen < 8)
+      fail("queued write not sent");
+   memcpy(f, wire, 6);
+   rx_frame(f, add_crc(f, 6), 0);
+   txlen = 0;
+   txsocks = 0;
+   gateway();
+   if (txlen != MODBUS_MBAP_LEN + 5 || tx[1] != tid)
+      fail("write not answered");
+}
+
+//the master on connection 1 gets qty registers at addr from the cache,
+//without a transaction on the line
+static void cache_hit(BYTE tid, int16 addr, BYTE qty, const char *what) {
+   ask(1, tid, addr, qty);
+   if (txsocks != 1 || !answered(1, tid, addr, qty))
+      fail(what);
+   ModbusGatewayTask();
+   tx_drain();
+   if (wirelen || ModbusGwIn != ModbusGwOut)
+      fail("cached read went to the line");
+}
+
+//reads of the range in MODBUS_GW_CACHE, 1000..1009
+static void test_cache(void) {
+   BYTE pdu[10];
+
+   ModbusTCPReset(0, 0);
+   ModbusTCPReset(1, 1);
+
+   //a read into the empty range is widened to all of it and fills it
+   request_on(0, 30, 1002, 2);
+   expect_read(1000, 10, "read not widened to the cached range");
+   slave_read(1000, 10);
+   if (txsocks != 1 || !answered(0, 30, 1002, 2))
+      fail("widened read not answered");
+
+   //which then answers reads inside it while fresh
+   cache_hit(31, 1004, 3, "fresh range did not answer");
+   ticks += CACHE_AGE;
+   cache_hit(32, 1000, 10, "range did not answer up to its maximum age");
+
+   //and no longer once older
+   ticks++;
+   request_on(0, 33, 1009, 1);
+   expect_read(1000, 10, "stale range not read again");
+   slave_read(1000, 10);
+   if (txsocks != 1 || !answered(0, 33, 1009, 1))
+      fail("read of the stale range not answered");
+   cache_hit(34, 1009, 1, "refreshed range did not answer");
+
+   //a single register write into the range invalidates it
+   pdu[0] = FUNC_WRITE_SINGLE_REGISTER;
+   pdu[1] = 1005 >> 8;
+   pdu[2] = 1005 & 0xFF;
+   pdu[3] = 0;
+   pdu[4] = 1;
+   master(0, 35, pdu, 5);
+   slave_echo(35);
+   request_on(1, 36, 1000, 2);
+   expect_read(1000, 10, "range written with FC6 still answered");
+   slave_read(1000, 10);
+   if (txsocks != 1 || !answered(1, 36, 1000, 2))
+      fail("read after FC6 not answered");
+   cache_hit(37, 1000, 2, "range not refilled after FC6");
+
+   //so does a multiple register write, and a read queued behind it
+   //waits for the slave
+   pdu[0] = FUNC_WRITE_MULTIPLE_REGISTERS;
+   pdu[1] = 1008 >> 8;
+   pdu[2] = 1008 & 0xFF;
+   pdu[3] = 0;
+   pdu[4] = 2;
+   pdu[5] = 4;
+   memset(&pdu[6], 0, 4);
+   master(0, 38, pdu, 10);
+   request_on(1, 39, 1000, 2);
+   slave_echo(38);
+   if (ModbusGwState != MB_GW_WAIT)
+      fail("read behind FC16 not sent");
+   tx_drain();
+   slave_read(1000, 10);
+   if (txsocks != 1 || !answered(1, 39, 1000, 2))
+      fail("read after FC16 not answered");
+}
+
+static void test_gateway(void) {
+   BYTE f[64], q[8];
+   int i, n;
+
+   ModbusTCPReset(0, SOCK);
+
+   //the request goes out on the line with its CRC
+   request(1, 10, 3);
+   ModbusGatewayTask();
+   tx_drain();
+   n = 0;
+   q[n++] = SLAVE;
+   q[n++] = FUNC_READ_HOLDING_REGISTERS;
+   q[n++] = 0;
+   q[n++] = 10;
+   q[n++] = 0;
+   q[n++] = 3;
+   n = add_crc(q, n);
+   if (wirelen != n || memcmp(wire, q, n))
+      fail("gateway sent a wrong RTU frame");
+
+   //noise with a bad CRC is ignored, the reply after it relayed
+   n = 0;
+   f[n++] = SLAVE;
+   f[n++] = FUNC_READ_HOLDING_REGISTERS;
+   f[n++] = 6;
+   for (i=0;i<6;i++)
+      f[n++] = 0xA0 + i;
+   n = add_crc(f, n);
+   f[4] ^= 0x10;
+   rx_frame(f, n, CHAR_TICKS);
+   gateway();
+   if (txlen)
+      fail("reply with a bad CRC relayed");
+   f[4] ^= 0x10;
+   rx_frame(f, n, CHAR_TICKS);
+   gateway();
+   if (txlen != MODBUS_MBAP_LEN + 8 || tx[1] != 1 || tx[6] != SLAVE ||
+       memcmp(&tx[MODBUS_MBAP_LEN], &f[1], 8))
+      fail("reply not relayed to the master");
+
+   //a slave that does not answer gets exception 0x0B, which needs no
+   //more room in the socket than its own 9 bytes
+   request(2, 20, 1);
+   ModbusGatewayTask();
+   tx_drain();
+   ticks += MODBUS_GW_TIMEOUT + 1;
+   putfree = MODBUS_MBAP_LEN + 1;
+   gateway();
+   if (txlen)
+      fail("exception put into a socket without room for it");
+   putfree = MODBUS_MBAP_LEN + 2;
+   gateway();
+   putfree = 970;
+   if (txlen != MODBUS_MBAP_LEN + 2 || tx[1] != 2 ||
+       tx[MODBUS_MBAP_LEN] != (FUNC_READ_HOLDING_REGISTERS | 0x80) ||
+       tx[MODBUS_MBAP_LEN + 1] != GATEWAY_TARGET_NO_RESPONSE)
+      fail("no exception 0x0B for a slave that does not answer");
+
+   test_gateway_max();
+}
+
+int main(void) {
+   srand(1);
+   ModbusRTUInit();
+   test_crc();
+   test_t35();
+   test_gateway();
+   test_coalesce();
+   test_cache();
+   printf("test_mbrtu: ok\n");
+   return(0);
+}
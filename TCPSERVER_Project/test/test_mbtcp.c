@@ -0,0 +1,358 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// test_mbtcp.c - Host test of the Modbus TCP framer (mbtcp.c).
+//
+// A random stream of requests is first served one request per segment
+// with the socket always able to reply, which gives the reference replies.
+// The same stream is then fed again cut at random points, every split
+// point inside the MBAP header included, with the socket at random not
+// able to reply, and must produce exactly the same replies.  Like the
+// stack, the fake socket takes only the part of a segment that
+// ModbusTCPAccept() agrees to; the master sends the rest again.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "tcpip/tcp.h"
+
+#include "modbus/mbdata.c"
+#include "modbus/mbmap.c"
+#include "modbus/modbus.c"
+#include "modbus/mbtcp.c"
+
+#define SOCK      0
+
+//the segment held by the fake socket
+static BYTE seg[2048];
+static int  seglen, segpos;
+static BOOL getready;
+
+//the replies sent so far, one transmit segment at a time
+static BYTE tx[65536];
+static int  txlen, txseg, flushes;
+static BOOL putready;
+
+TICKTYPE TickGet(void) { return(0); }
+
+BOOL TCPIsGetReady(TCP_SOCKET s) { return(getready); }
+
+int16 TCPGetAvailable(TCP_SOCKET s) {
+   return(getready ? seglen - segpos : 0);
+}
+
+WORD TCPGetArray(TCP_SOCKET s, BYTE *buff, WORD count) {
+   if (count > seglen - segpos)
+      count = seglen - segpos;
+   memcpy(buff, &seg[segpos], count);
+   segpos += count;
+   return(count);
+}
+
+BOOL TCPGet(TCP_SOCKET s, BYTE *data) {
+   if (segpos >= seglen)
+      return(FALSE);
+   *data = seg[segpos++];
+   return(TRUE);
+}
+
+WORD TCPPeek(TCP_SOCKET s, WORD offset, BYTE *buff, WORD count) {
+   if (!getready || segpos + offset >= seglen)
+      return(0);
+   if (count > seglen - segpos - offset)
+      count = seglen - segpos - offset;
+   memcpy(buff, &seg[segpos + offset], count);
+   return(count);
+}
+
+BOOL TCPDiscard(TCP_SOCKET s) {
+   getready = FALSE;
+   return(TRUE);
+}
+
+BOOL TCPIsPutReady(TCP_SOCKET s) { return(putready); }
+
+int16 TCPPutAvailable(TCP_SOCKET s) {
+   return(putready ? 970 - txseg : 0);
+}
+
+BOOL TCPPutReserve(TCP_SOCKET s, WORD len) {
+   if (TCPPutAvailable(s) < len)
+      return(FALSE);
+   txseg += len;
+   return(TRUE);
+}
+
+BOOL TCPFlush(TCP_SOCKET s) {
+   txseg = 0;
+   flushes++;
+   return(TRUE);
+}
+
+void MACPut(BYTE b) { tx[txlen++] = b; }
+
+void MACPutArray(BYTE *b, WORD len) {
+   memcpy(&tx[txlen], b, len);
+   txlen += len;
+}
+
+static BYTE stream[16384];
+static int  slen;
+static int  starts[256], nreq;      //offset of every request in stream
+
+//appends one random request to stream
+static void gen_request(int tid) {
+   BYTE pdu[256];
+   int  n, k, fc, addr, qty;
+
+   n = 0;
+   fc = rand() % 8;
+   addr = rand() % 100;
+   qty = 1 + rand() % 20;
+   switch (fc) {
+      case 0: pdu[n++] = FUNC_READ_HOLDING_REGISTERS; break;
+      case 1: pdu[n++] = FUNC_READ_INPUT_REGISTERS; break;
+      case 2: pdu[n++] = FUNC_READ_COILS; qty = 1 + rand() % 300; break;
+      case 3: pdu[n++] = FUNC_WRITE_MULTIPLE_REGISTERS; break;
+      case 4: pdu[n++] = FUNC_WRITE_SINGLE_REGISTER; break;
+      case 5: pdu[n++] = FUNC_WRITE_MULTIPLE_COILS; qty = 1 + rand() % 100; break;
+      case 6: pdu[n++] = FUNC_READ_WRITE_MULTIPLE_REGISTERS; break;
+      case 7: pdu[n++] = 0x41; break;        //unsupported, exception 1
+   }
+   pdu[n++] = addr >> 8;
+   pdu[n++] = addr;
+   if (fc == 4) {
+      pdu[n++] = rand();
+      pdu[n++] = rand();
+   }
+   else {
+      pdu[n++] = qty >> 8;
+      pdu[n++] = qty;
+   }
+   if (fc == 6) {
+      pdu[n++] = addr >> 8;
+      pdu[n++] = addr;
+      pdu[n++] = 0;
+      pdu[n++] = qty;
+   }
+   if (fc == 3 || fc == 6) {
+      pdu[n++] = qty * 2;
+      for (k=0;k<qty*2;k++)
+         pdu[n++] = rand();
+   }
+   if (fc == 5) {
+      pdu[n++] = (qty + 7) / 8;
+      for (k=0;k<(qty+7)/8;k++)
+         pdu[n++] = rand();
+   }
+
+   starts[nreq++] = slen;
+   stream[slen++] = tid >> 8;
+   stream[slen++] = tid;
+   stream[slen++] = 0;
+   stream[slen++] = 0;
+   stream[slen++] = (n + 1) >> 8;
+   stream[slen++] = n + 1;
+   stream[slen++] = MODBUS_UNIT;
+   memcpy(&stream[slen], pdu, n);
+   slen += n;
+}
+
+static void gen_stream(int count) {
+   int i;
+
+   slen = 0;
+   nreq = 0;
+   for (i=0;i<count;i++)
+      gen_request(i);
+   starts[nreq] = slen;
+}
+
+//restarts the connection and the register store
+static void restart(void) {
+   memset(hold_regs, 0, sizeof(hold_regs));
+   memset(input_regs, 0, sizeof(input_regs));
+   memset(coils, 0, sizeof(coils));
+   ModbusTCPReset(0, SOCK);
+   txlen = 0;
+   txseg = 0;
+}
+
+//offers n bytes of stream at pos to the framer, which must serve or keep
+//all it accepts.  returns the number of bytes accepted.
+static int deliver(int pos, int n) {
+   n = ModbusTCPAccept(SOCK, n);
+   memcpy(seg, &stream[pos], n);
+   seglen = n;
+   segpos = 0;
+   getready = n > 0;
+   if (ModbusTCPTask(SOCK, 0)) {
+      printf("connection dropped at stream offset %d\n", pos);
+      exit(1);
+   }
+   if (getready || segpos != seglen) {
+      printf("segment at stream offset %d not consumed\n", pos);
+      exit(1);
+   }
+   return(n);
+}
+
+//serves stream cut into segments of 1..maxseg bytes, the socket able to
+//reply with probability 1 in busy
+static void run_split(int maxseg, int busy) {
+   int pos, n, guard;
+
+   restart();
+   pos = 0;
+   for (guard=0;pos < slen || ModbusConn[0].count;guard++) {
+      if (guard > 100000) {
+         printf("framer stuck at stream offset %d\n", pos);
+         exit(1);
+      }
+      putready = busy ? rand() % busy == 0 : TRUE;
+      txseg = 0;
+      n = 1 + rand() % maxseg;
+      if (n > slen - pos)
+         n = slen - pos;
+      pos += deliver(pos, n);
+   }
+}
+
+static BYTE ref[65536];
+static int  reflen;
+
+static void check(const char *what, int it) {
+   if (txlen != reflen || memcmp(tx, ref, reflen)) {
+      printf("%s, stream %d: replies differ (%d bytes, expected %d)\n",
+             what, it, txlen, reflen);
+      exit(1);
+   }
+}
+
+//pipelined small reads must all be answered in one transmit segment
+static void test_batch(void) {
+   BYTE pdu[5] = {FUNC_READ_HOLDING_REGISTERS, 0, 0, 0, 2};
+   int i;
+
+   slen = 0;
+   nreq = 0;
+   for (i=0;i<20;i++) {
+      starts[nreq++] = slen;
+      stream[slen++] = 0;
+      stream[slen++] = i;
+      stream[slen++] = 0;
+      stream[slen++] = 0;
+      stream[slen++] = 0;
+      stream[slen++] = 6;
+      stream[slen++] = MODBUS_UNIT;
+      memcpy(&stream[slen], pdu, 5);
+      slen += 5;
+   }
+   restart();
+   putready = TRUE;
+   flushes = 0;
+   deliver(0, slen);
+   if (flushes != 1 || txlen != 20 * (MODBUS_MBAP_LEN + 6)) {
+      printf("20 small reads: %d bytes in %d segments\n", txlen, flushes);
+      exit(1);
+   }
+}
+
+//two pipelined large writes while the socket can not reply hold the
+//master back instead of losing the connection
+static void test_backpressure(void) {
+   BYTE pdu[256];
+   int i, k, n, pos;
+
+   slen = 0;
+   nreq = 0;
+   for (i=0;i<2;i++) {
+      n = 0;
+      pdu[n++] = FUNC_WRITE_MULTIPLE_REGISTERS;
+      pdu[n++] = 0;
+      pdu[n++] = 0;
+      pdu[n++] = 0;
+      pdu[n++] = 123;
+      pdu[n++] = 246;
+      for (k=0;k<246;k++)
+         pdu[n++] = i;
+      starts[nreq++] = slen;
+      stream[slen++] = 0;
+      stream[slen++] = i;
+      stream[slen++] = 0;
+      stream[slen++] = 0;
+      stream[slen++] = 0;
+      stream[slen++] = n + 1;
+      stream[slen++] = MODBUS_UNIT;
+      memcpy(&stream[slen], pdu, n);
+      slen += n;
+   }
+   restart();
+   putready = FALSE;
+   pos = deliver(0, slen);
+   if (pos >= slen) {
+      printf("%d bytes taken while unable to reply\n", pos);
+      exit(1);
+   }
+   //the rest is refused until the replies can go out
+   if (deliver(pos, slen - pos)) {
+      printf("segment taken into a full buffer\n");
+      exit(1);
+   }
+   putready = TRUE;
+   for (i=0;pos < slen && i<4;i++) {
+      txseg = 0;
+      pos += deliver(pos, slen - pos);
+   }
+   if (pos != slen || txlen != 2 * (MODBUS_MBAP_LEN + 5)
+                   || hold_regs[122] != 1) {
+      printf("pipelined writes: %d of %d bytes taken, %d bytes replied\n",
+             pos, slen, txlen);
+      exit(1);
+   }
+}
+
+int main(void) {
+   int it, i, k, cut;
+
+   test_batch();
+   test_backpressure();
+
+   for (it=0;it<200;it++) {
+      srand(it);
+      gen_stream(30);
+
+      //reference: one request per segment, always able to reply
+      restart();
+      putready = TRUE;
+      for (i=0;i<nreq;i++) {
+         txseg = 0;
+         deliver(starts[i], starts[i + 1] - starts[i]);
+      }
+      memcpy(ref, tx, txlen);
+      reflen = txlen;
+
+      //whole stream in large segments, then in small ones
+      for (k=0;k<4;k++) {
+         run_split(600, 0);
+         check("large segments", it);
+         run_split(1 + rand() % 40, 3);
+         check("small segments", it);
+      }
+
+      //the first two requests split at every point of the first one,
+      //inside the MBAP header included
+      for (cut=1;cut<starts[2];cut++) {
+         restart();
+         putready = TRUE;
+         deliver(0, cut);
+         deliver(cut, starts[2] - cut);
+         memcpy(ref, tx, txlen);
+         reflen = txlen;
+         restart();
+         deliver(0, starts[1]);
+         deliver(starts[1], starts[2] - starts[1]);
+         check("split inside a request", it);
+      }
+   }
+   printf("test_mbtcp: ok\n");
+   return(0);
+}